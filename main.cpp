@@ -37,17 +37,21 @@ void on_export_mmap( void* this_ptr ) {
 int main( ) {
     printf( "hello, sample!\n" );
 
-    if ( !pzm::setup( ) ) {
-        printf( "failed to setup instance\n" );
-        return 1;
-    }
+    // the transport can be changed before setup, e.g. for a local mutator sidecar:
+    // pzm::transport_config_t transport;
+    // transport.endpoint = "localhost:8080/ws/mutator";
+    // transport.secure = false;
+    // pzm::setup( transport );
 
     pzm::username = "username"; // your username from website
     pzm::password = "password"; // your password from website
 
-    if ( !pzm::auth( ) ) {
-        printf( "failed to auth, check your credentials and subscription\n" );
-        return 2;
+    // prewarm is setup + auth without waiting for the server, the image below is loaded meanwhile
+    // keeping the tls session on disk lets the next run resume it instead of a full handshake:
+    // transport.session_cache_file = "mutator_session.pem";
+    if ( !pzm::prewarm( ) ) {
+        printf( "failed to setup instance\n" );
+        return 1;
     }
 
     // create a new directory inside a folder with executable
@@ -55,6 +59,11 @@ int main( ) {
     // pass the directory name as a string argument to set_directory function
     pzm::instance->set_directory( "test" );
 
+    if ( !pzm::auth( ) ) {
+        printf( "failed to auth, check your credentials and subscription\n" );
+        return 2;
+    }
+
     // you can add several callbacks by calling add_callback function
     // every callback handler will be executed once callback conditions are reached
     // for detailed documentation please refer to our website
@@ -67,6 +76,14 @@ int main( ) {
     pzm::instance->set_option< bool >( pzm::option_t::OPTION_SHUFFLE, true );
     pzm::instance->set_option< bool >( pzm::option_t::OPTION_PARTITION, true );
 
+    // repeated runs with the same binary, options and client layout (tests, staging) may reuse results from disk
+    // cached results are only served by map( ) and the upload is deferred until the cache misses
+    // pzm::instance->enable_cache( "mutator_cache" );
+
+    // every phase ( connect, upload, mutation, proceed, ... ) is timed, the same timings can be written
+    // as a chrome trace, open it in chrome://tracing or perfetto:
+    // pzm::g_stats.set_trace( std::make_shared< pzm::c_trace_sink >( "mutator_trace.json" ) );
+
     auto status = pzm::instance->initialize( );
     if ( status != pzm::status_t::STATUS_SUCCESS ) {
         printf( "error (code %d) occurred!\n", status );
@@ -96,6 +113,17 @@ int main( ) {
             client_info[ "imports" ][ imported_module.first ][ function.get< std::string >( ) ] = 0x77000000;
     }
 
+    // servers that understand the indexed form take large import tables as client_info[ "import_table" ] instead,
+    // which names the modules and keeps the functions in the order of their module's array in mapper_data[ "imports" ]:
+    // auto import_table = pzm::make_import_table( mapper_data, [ ] ( const std::string& module, const std::string& function ) -> uint64_t {
+    //     return 0x77000000;
+    // } );
+    // client_info[ "import_table" ] = import_table.to_json( );
+
+    // if bases and imports are known up front (fixed bases, pre-resolved imports), get_mapper_data and proceed
+    // can be replaced with a single round trip: pzm::instance->map( client_info, mapper_data, mapped_binaries )
+    // in that case client_info is built without the "client_id" field, the server assigns it
+
     // for now binary is already mutated and ready to be mapped and launched
     // create an std::vector< uint8_t > which will later contain entire PE binary
     // pass client information and reference to binary storage as arguments in proceed function
@@ -111,6 +139,9 @@ int main( ) {
         ( long long ) mapped_binaries.at( 0 ).size( ) );
     test_binary.close( );
 
+    // per-phase latency: count, mean and p50 / p90 / p99 / p999 / max in microseconds
+    printf( "[+] phase stats - %s\n", pzm::g_stats.snapshot( ).dump( ).c_str( ) );
+
     pzm::unload( );
     return 0;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SIMPLE_WEB_ASIO_COMPATIBILITY_HPP
 
 #include <memory>
+#include <utility>
 
 #ifdef ASIO_STANDALONE
 #include <asio.hpp>
@@ -46,6 +47,14 @@ namespace SimpleWeb {
   std::unique_ptr<asio::steady_timer> make_steady_timer(socket_type &socket, std::chrono::duration<duration_type> duration) {
     return std::unique_ptr<asio::steady_timer>(new asio::steady_timer(socket.get_executor(), duration));
   }
+  template <typename socket_type>
+  io_context &get_io_context(socket_type &socket) noexcept {
+#if(ASIO_STANDALONE && ASIO_VERSION >= 101700) || BOOST_ASIO_VERSION >= 101700
+    return static_cast<io_context &>(asio::query(socket.get_executor(), asio::execution::context));
+#else
+    return static_cast<io_context &>(socket.get_executor().context());
+#endif
+  }
   template <typename handler_type>
   void async_resolve(asio::ip::tcp::resolver &resolver, const std::pair<std::string, std::string> &host_port, handler_type &&handler) {
     resolver.async_resolve(host_port.first, host_port.second, std::forward<handler_type>(handler));
@@ -72,6 +81,10 @@ namespace SimpleWeb {
   std::unique_ptr<asio::steady_timer> make_steady_timer(socket_type &socket, std::chrono::duration<duration_type> duration) {
     return std::unique_ptr<asio::steady_timer>(new asio::steady_timer(socket.get_io_service(), duration));
   }
+  template <typename socket_type>
+  io_context &get_io_context(socket_type &socket) noexcept {
+    return socket.get_io_service();
+  }
   template <typename handler_type>
   void async_resolve(asio::ip::tcp::resolver &resolver, const std::pair<std::string, std::string> &host_port, handler_type &&handler) {
     resolver.async_resolve(asio::ip::tcp::resolver::query(host_port.first, host_port.second), std::forward<handler_type>(handler));
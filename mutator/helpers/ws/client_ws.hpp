@@ -4,13 +4,14 @@
 #include "asio_compatibility.hpp"
 #include "crypto.hpp"
 #include "mutex.hpp"
+#include "timer_wheel.hpp"
+#include "transport_stats.hpp"
 #include "utility.hpp"
 #include <array>
 #include <atomic>
 #include <iostream>
 #include <limits>
 #include <list>
-#include <random>
 
 namespace SimpleWeb {
     template <class socket_type>
@@ -82,10 +83,18 @@ namespace SimpleWeb {
 
             long timeout_idle;
             Mutex timer_mutex;
-            std::unique_ptr<asio::steady_timer> timer GUARDED_BY(timer_mutex);
+            std::shared_ptr<TimerWheel::Entry> timer_entry GUARDED_BY(timer_mutex);
+            TimerWheel *timer_wheel GUARDED_BY(timer_mutex) = nullptr;
+            /// Idle timeouts send a close frame first, request timeouts close the connection right away
+            std::atomic<bool> timeout_is_idle{false};
 
             std::atomic<bool> close_sent;
 
+            /// Set right after the TLS handshake if the kernel encrypts outgoing records, writes then bypass the TLS stream
+            bool kernel_tls = false;
+
+            TransportCounters counters;
+
             asio::ip::tcp::endpoint endpoint; // The endpoint is read in SocketClient::upgrade and must be stored so that it can be read reliably in all handlers, including on_error
 
             void set_timeout(long seconds = -1) noexcept {
@@ -95,57 +104,76 @@ namespace SimpleWeb {
                     seconds = timeout_idle;
                 }
 
-                LockGuard lock(timer_mutex);
-
-                if(seconds == 0) {
-                    timer = nullptr;
-                    return;
-                }
+                // Rearming is the common case and only updates the entry's deadline in the context's timer wheel
+                std::shared_ptr<TimerWheel::Entry> entry;
+                TimerWheel *wheel;
+                try {
+                    LockGuard lock(timer_mutex);
+                    if(!timer_entry) {
+                        if(seconds == 0)
+                            return;
 
-                timer = make_steady_timer(*socket, std::chrono::seconds(seconds));
-                std::weak_ptr<Connection> connection_weak(this->shared_from_this()); // To avoid keeping Connection instance alive longer than needed
-                timer->async_wait([connection_weak, use_timeout_idle](const error_code &ec) {
-                    if(!ec) {
-                        if(auto connection = connection_weak.lock()) {
-                            if(use_timeout_idle) {
-                                if(connection->close_sent)
-                                    connection->close();
+                        std::weak_ptr<Connection> connection_weak(this->shared_from_this()); // To avoid keeping Connection instance alive longer than needed
+                        timer_entry = std::make_shared<TimerWheel::Entry>([connection_weak] {
+                            if(auto connection = connection_weak.lock()) {
+                                if(connection->timeout_is_idle) {
+                                    if(connection->close_sent)
+                                        connection->close();
+                                    else
+                                        connection->send_close(1000, "idle timeout"); // 1000=normal closure
+                                }
                                 else
-                                    connection->send_close(1000, "idle timeout"); // 1000=normal closure
+                                    connection->close();
                             }
-                            else
-                                connection->close();
-                        }
+                        });
+                        timer_wheel = &TimerWheel::get(socket->lowest_layer());
                     }
-                });
+                    entry = timer_entry;
+                    wheel = timer_wheel;
+                }
+                catch(...) {
+                    return;
+                }
+
+                timeout_is_idle = use_timeout_idle;
+                try {
+                    wheel->set(entry, seconds);
+                }
+                catch(...) {
+                }
             }
 
             void cancel_timeout() noexcept {
                 LockGuard lock(timer_mutex);
-                if(timer) {
-                    try {
-                        timer->cancel();
-                    }
-                    catch(...) {
-                    }
-                }
+                if(timer_entry)
+                    timer_wheel->cancel(*timer_entry);
+            }
+
+            template <typename buffers_type, typename handler_type>
+            void async_write(buffers_type &&buffers, handler_type &&handler) {
+                if(kernel_tls)
+                    asio::async_write(static_cast<asio::ip::tcp::socket &>(socket->lowest_layer()), std::forward<buffers_type>(buffers), std::forward<handler_type>(handler));
+                else
+                    asio::async_write(*socket, std::forward<buffers_type>(buffers), std::forward<handler_type>(handler));
             }
 
             class OutData {
             public:
                 OutData(std::shared_ptr<OutMessage> out_message_, std::function<void(const error_code)> &&callback_) noexcept
-                        : out_message(std::move(out_message_)), callback(std::move(callback_)) {}
+                        : out_message(std::move(out_message_)), callback(std::move(callback_)), queued_at(std::chrono::steady_clock::now()) {}
                 std::shared_ptr<OutMessage> out_message;
                 std::function<void(const error_code)> callback;
+                std::chrono::steady_clock::time_point queued_at;
             };
 
             Mutex send_queue_mutex;
             std::list<OutData> send_queue GUARDED_BY(send_queue_mutex);
 
             void send_from_queue() REQUIRES(send_queue_mutex) {
+                counters.write_started(send_queue.begin()->queued_at);
                 auto self = this->shared_from_this();
                 set_timeout();
-                asio::async_write(*self->socket, send_queue.begin()->out_message->streambuf, [self](const error_code &ec, std::size_t /*bytes_transferred*/) {
+                async_write(send_queue.begin()->out_message->streambuf, [self](const error_code &ec, std::size_t bytes_transferred) {
                     self->set_timeout(); // Set timeout for next send
                     auto lock = self->handler_runner->continue_lock();
                     if(!lock)
@@ -153,6 +181,8 @@ namespace SimpleWeb {
                     {
                         LockGuard lock(self->send_queue_mutex);
                         if(!ec) {
+                            self->counters.frame_sent(bytes_transferred);
+                            self->counters.messages_dequeued(1);
                             auto it = self->send_queue.begin();
                             auto callback = std::move(it->callback);
                             self->send_queue.erase(it);
@@ -170,6 +200,7 @@ namespace SimpleWeb {
                                 if(out_data.callback)
                                     callbacks.emplace_back(std::move(out_data.callback));
                             }
+                            self->counters.messages_dequeued(self->send_queue.size());
                             self->send_queue.clear();
 
                             lock.unlock();
@@ -186,10 +217,7 @@ namespace SimpleWeb {
             void send(const std::shared_ptr<OutMessage> &out_message, std::function<void(const error_code &)> callback = nullptr, unsigned char fin_rsv_opcode = 129) {
                 // Create mask
                 std::array<unsigned char, 4> mask;
-                std::uniform_int_distribution<unsigned short> dist(0, 255);
-                std::random_device rd;
-                for(std::size_t c = 0; c < 4; c++)
-                    mask[c] = static_cast<unsigned char>(dist(rd));
+                Crypto::random_bytes(mask.data(), mask.size());
 
                 std::size_t length = out_message->size();
 
@@ -223,6 +251,7 @@ namespace SimpleWeb {
 
                 LockGuard lock(send_queue_mutex);
                 send_queue.emplace_back(std::move(out_header_and_message), std::move(callback));
+                counters.message_queued();
                 if(send_queue.size() == 1)
                     send_from_queue();
             }
@@ -263,6 +292,11 @@ namespace SimpleWeb {
             const asio::ip::tcp::endpoint &remote_endpoint() const noexcept {
                 return endpoint;
             }
+
+            /// Counters of this connection, SocketClientBase::transport_stats() has the totals of all connections made by the client
+            TransportStats transport_stats() const noexcept {
+                return counters.snapshot();
+            }
         };
 
         class Config {
@@ -286,6 +320,14 @@ namespace SimpleWeb {
             std::string proxy_server;
             /// Set proxy authorization (username:password)
             std::string proxy_auth;
+            /// Make use of RFC 7413 or TCP Fast Open (TFO) when connecting. Linux only.
+            bool fast_open = false;
+            /// File the TLS session is kept in between runs, so that later processes resume it instead of running a full handshake.
+            /// The file holds resumption secrets and is created readable by the owner only. WSS only.
+            std::string session_cache_file;
+            /// Let the kernel encrypt outgoing records of TLS 1.3 connections (kTLS), falls back to OpenSSL where unavailable.
+            /// Linux and WSS only.
+            bool kernel_tls = false;
         };
         /// Set before calling start().
         Config config;
@@ -341,6 +383,11 @@ namespace SimpleWeb {
             stop();
         }
 
+        /// Totals of all connections made so far, including earlier ones when start() is called again
+        TransportStats transport_stats() const noexcept {
+            return counters->snapshot();
+        }
+
         /// If you have your own io_context, store its pointer here before running start().
         std::shared_ptr<io_context> io_service;
 
@@ -359,6 +406,8 @@ namespace SimpleWeb {
 
         std::shared_ptr<ScopeRunner> handler_runner;
 
+        std::shared_ptr<TransportCounters> counters = std::make_shared<TransportCounters>();
+
         SocketClientBase(const std::string &host_port_path, unsigned short default_port) noexcept : default_port(default_port), handler_runner(new ScopeRunner()) {
             auto host_port_end = host_port_path.find('/');
             auto host_port = parse_host_port(host_port_path.substr(0, host_port_end), default_port);
@@ -403,7 +452,58 @@ namespace SimpleWeb {
 
         virtual void connect() = 0;
 
+        /// Connects to the first resolved endpoint that accepts the connection.
+        /// With fast_open the first data written, the TLS ClientHello or the upgrade request, is sent with the SYN
+        /// once the server has handed out a Fast Open cookie.
+        void connect_socket(const std::shared_ptr<Connection> &connection, const resolver_results &results, std::function<void(const error_code &)> handler) {
+            if(!config.fast_open) {
+                asio::async_connect(connection->socket->lowest_layer(), results, [handler](const error_code &ec, async_connect_endpoint /*endpoint*/) {
+                    handler(ec);
+                });
+                return;
+            }
+
+            auto endpoints = std::make_shared<std::vector<asio::ip::tcp::endpoint>>();
+            for(asio::ip::basic_resolver_iterator<asio::ip::tcp> it = results, end; it != end; ++it)
+                endpoints->emplace_back(it->endpoint());
+            connect_endpoint(connection, std::move(endpoints), 0, std::move(handler));
+        }
+
+        void connect_endpoint(const std::shared_ptr<Connection> &connection, std::shared_ptr<std::vector<asio::ip::tcp::endpoint>> endpoints, std::size_t index,
+                              std::function<void(const error_code &)> handler) {
+            if(index >= endpoints->size()) {
+                handler(make_error_code::make_error_code(errc::host_unreachable));
+                return;
+            }
+
+            auto &socket = connection->socket->lowest_layer();
+            error_code ec;
+            socket.close(ec);
+            socket.open((*endpoints)[index].protocol(), ec);
+            if(ec) {
+                connect_endpoint(connection, std::move(endpoints), index + 1, std::move(handler));
+                return;
+            }
+#if defined(__linux__) && defined(TCP_FASTOPEN_CONNECT)
+            // Ignored if the kernel doesn't support it, the connection is then made as usual
+            socket.set_option(asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_FASTOPEN_CONNECT>(true), ec);
+#endif
+            auto endpoint = (*endpoints)[index];
+            socket.async_connect(endpoint, [this, connection, endpoints, index, handler](const error_code &ec) mutable {
+                if(ec && ec != error::operation_aborted && index + 1 < endpoints->size()) {
+                    auto lock = connection->handler_runner->continue_lock();
+                    if(!lock)
+                        return;
+                    connect_endpoint(connection, std::move(endpoints), index + 1, std::move(handler));
+                }
+                else
+                    handler(ec);
+            });
+        }
+
         void upgrade(const std::shared_ptr<Connection> &connection) {
+            connection->counters.parent = counters;
+
             auto corrected_path = path;
             if(!config.proxy_server.empty() && std::is_same<socket_type, asio::ip::tcp::socket>::value)
                 corrected_path = "http://" + host + ':' + std::to_string(port) + corrected_path;
@@ -419,12 +519,8 @@ namespace SimpleWeb {
             ostream << "Connection: Upgrade\r\n";
 
             // Make random 16-byte nonce
-            std::string nonce;
-            nonce.reserve(16);
-            std::uniform_int_distribution<unsigned short> dist(0, 255);
-            std::random_device rd;
-            for(std::size_t c = 0; c < 16; c++)
-                nonce += static_cast<char>(dist(rd));
+            std::string nonce(16, '\0');
+            Crypto::random_bytes(reinterpret_cast<unsigned char *>(&nonce[0]), nonce.size());
 
             auto nonce_base64 = std::make_shared<std::string>(Crypto::Base64::encode(nonce));
             ostream << "Sec-WebSocket-Key: " << *nonce_base64 << "\r\n";
@@ -442,7 +538,7 @@ namespace SimpleWeb {
             connection->in_message = std::shared_ptr<InMessage>(new InMessage());
 
             connection->set_timeout(config.timeout_request);
-            asio::async_write(*connection->socket, *streambuf, [this, connection, streambuf, nonce_base64](const error_code &ec, std::size_t /*bytes_transferred*/) {
+            connection->async_write(*streambuf, [this, connection, streambuf, nonce_base64](const error_code &ec, std::size_t /*bytes_transferred*/) {
                 connection->cancel_timeout();
                 auto lock = connection->handler_runner->continue_lock();
                 if(!lock)
@@ -470,9 +566,7 @@ namespace SimpleWeb {
                                 return;
                             }
                             auto header_it = connection->header.find("Sec-WebSocket-Accept");
-                            static auto ws_magic_string = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-                            if(header_it != connection->header.end() &&
-                               Crypto::Base64::decode(header_it->second) == Crypto::sha1(*nonce_base64 + ws_magic_string)) {
+                            if(header_it != connection->header.end() && header_it->second == Crypto::websocket_accept(*nonce_base64)) {
                                 this->connection_open(connection);
                                 read_message(connection, num_additional_bytes);
                             }
@@ -577,6 +671,7 @@ namespace SimpleWeb {
 
         void read_message_content(const std::shared_ptr<Connection> &connection, std::size_t num_additional_bytes) {
             if(connection->in_message->length + (connection->fragmented_in_message ? connection->fragmented_in_message->length : 0) > config.max_message_size) {
+                connection->counters.message_oversized();
                 connection_error(connection, make_error_code::make_error_code(errc::message_size));
                 const int status = 1009;
                 const std::string reason = "message too big";
@@ -606,6 +701,10 @@ namespace SimpleWeb {
                     else
                         next_in_message = std::shared_ptr<InMessage>(new InMessage());
 
+                    auto fin_rsv_opcode = connection->in_message->fin_rsv_opcode;
+                    connection->counters.frame_received(TransportCounters::header_size(connection->in_message->length, false) + connection->in_message->length,
+                                                        (fin_rsv_opcode & 0x80) == 0 || (fin_rsv_opcode & 0x0f) == 0);
+
                     // If connection close
                     if((connection->in_message->fin_rsv_opcode & 0x0f) == 8) {
                         int status = 0;
@@ -662,6 +761,7 @@ namespace SimpleWeb {
                         this->read_message(connection, updated_num_additional_bytes);
                     }
                     else {
+                        connection->counters.message_received();
                         if(this->on_message) {
                             if(connection->fragmented_in_message) {
                                 connection->fragmented_in_message->length += connection->in_message->length;
@@ -690,16 +790,19 @@ namespace SimpleWeb {
         }
 
         void connection_open(const std::shared_ptr<Connection> &connection) const {
+            connection->counters.connection_opened();
             if(on_open)
                 on_open(connection);
         }
 
         void connection_close(const std::shared_ptr<Connection> &connection, int status, const std::string &reason) const {
+            connection->counters.connection_closed();
             if(on_close)
                 on_close(connection, status, reason);
         }
 
         void connection_error(const std::shared_ptr<Connection> &connection, const error_code &ec) const {
+            connection->counters.connection_closed();
             if(on_error)
                 on_error(connection, ec);
         }
@@ -738,7 +841,7 @@ namespace SimpleWeb {
                     return;
                 if(!ec) {
                     connection->set_timeout(this->config.timeout_request);
-                    asio::async_connect(*connection->socket, results, [this, connection, resolver](const error_code &ec, async_connect_endpoint /*endpoint*/) {
+                    this->connect_socket(connection, results, [this, connection, resolver](const error_code &ec) {
                         connection->cancel_timeout();
                         auto lock = connection->handler_runner->continue_lock();
                         if(!lock)
@@ -2,6 +2,17 @@
 #define SIMPLE_WEB_CLIENT_WSS_HPP
 
 #include "client_ws.hpp"
+#include "ktls.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <openssl/pem.h>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #ifdef ASIO_STANDALONE
 #include <asio/ssl.hpp>
@@ -60,6 +71,15 @@ namespace SimpleWeb {
         asio::ssl::context context;
 
         void connect() override {
+            if(config.kernel_tls)
+                KernelTLS::prepare(context, false);
+
+            if(!config.session_cache_file.empty()) {
+                // Sessions are handed out through new_session only, a process never resumes from an internal cache
+                SSL_CTX_set_session_cache_mode(context.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+                SSL_CTX_sess_set_new_cb(context.native_handle(), new_session);
+            }
+
             LockGuard connection_lock(connection_mutex);
             auto connection = this->connection = std::shared_ptr<Connection>(new Connection(handler_runner, config.timeout_idle, *io_service, context));
             connection_lock.unlock();
@@ -81,7 +101,7 @@ namespace SimpleWeb {
                     return;
                 if(!ec) {
                     connection->set_timeout(this->config.timeout_request);
-                    asio::async_connect(connection->socket->lowest_layer(), results, [this, connection, resolver](const error_code &ec, async_connect_endpoint /*endpoint*/) {
+                    this->connect_socket(connection, results, [this, connection, resolver](const error_code &ec) {
                         connection->cancel_timeout();
                         auto lock = connection->handler_runner->continue_lock();
                         if(!lock)
@@ -146,6 +166,8 @@ namespace SimpleWeb {
 
         void handshake(const std::shared_ptr<Connection> &connection) {
             SSL_set_tlsext_host_name(connection->socket->native_handle(), this->host.c_str());
+            if(!this->config.session_cache_file.empty())
+                resume_session(connection->socket->native_handle(), this->config.session_cache_file);
 
             connection->set_timeout(this->config.timeout_request);
             connection->socket->async_handshake(asio::ssl::stream_base::client, [this, connection](const error_code &ec) {
@@ -153,12 +175,116 @@ namespace SimpleWeb {
                 auto lock = connection->handler_runner->continue_lock();
                 if(!lock)
                     return;
-                if(!ec)
+                if(!ec) {
+                    if(this->config.kernel_tls)
+                        connection->kernel_tls = KernelTLS::enable_send(connection->socket->native_handle(), connection->socket->lowest_layer().native_handle());
                     upgrade(connection);
+                }
                 else
                     this->connection_error(connection, ec);
             });
         }
+
+    private:
+        /// The cache file of a connection, kept with the SSL object since sessions may arrive after the client is gone
+        static int session_file_index() noexcept {
+            static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, [](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+                delete static_cast<std::string *>(ptr);
+            });
+            return index;
+        }
+
+        /// Offers the cached session if there is a usable one, the server falls back to a full handshake otherwise
+        static void resume_session(SSL *ssl, const std::string &file) noexcept {
+            try {
+                SSL_set_ex_data(ssl, session_file_index(), new std::string(file));
+
+                std::ifstream stream(file, std::ios::binary);
+                if(!stream)
+                    return;
+                std::string pem((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+                auto bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+                if(!bio)
+                    return;
+                auto session = PEM_read_bio_SSL_SESSION(bio, nullptr, nullptr, nullptr);
+                BIO_free(bio);
+                if(!session)
+                    return;
+
+                if(SSL_SESSION_is_resumable(session))
+                    SSL_set_session(ssl, session);
+                SSL_SESSION_free(session);
+            }
+            catch(...) {
+            }
+        }
+
+        /// Called for every session ticket the server sends, the file always holds the latest one.
+        /// Written to a temporary file first so that concurrent processes never read a partial session.
+        /// The temporary file is created readable by the owner only, it holds the resumption secret.
+        static int new_session(SSL *ssl, SSL_SESSION *session) {
+            auto file = static_cast<std::string *>(SSL_get_ex_data(ssl, session_file_index()));
+            if(!file || !SSL_SESSION_is_resumable(session))
+                return 0;
+
+            auto bio = BIO_new(BIO_s_mem());
+            if(!bio)
+                return 0;
+            if(PEM_write_bio_SSL_SESSION(bio, session)) {
+                char *data;
+                auto size = BIO_get_mem_data(bio, &data);
+                try {
+                    auto temporary = *file + ".tmp" + std::to_string(reinterpret_cast<std::uintptr_t>(ssl));
+                    if(!write_private(temporary, data, static_cast<std::size_t>(size))) {
+                        BIO_free(bio);
+                        return 0;
+                    }
+                    std::error_code ec;
+                    std::filesystem::rename(temporary, *file, ec);
+                    if(ec)
+                        std::filesystem::remove(temporary, ec);
+                }
+                catch(...) {
+                }
+            }
+            BIO_free(bio);
+            return 0; // The session is not kept
+        }
+
+        /// Creates path with mode 0600 from the start, so the data is never readable by others in between.
+        /// O_EXCL refuses to follow a link planted at path, a file left behind by an earlier crash is replaced.
+        static bool write_private(const std::string &path, const char *data, std::size_t size) {
+#ifndef _WIN32
+            auto fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+            if(fd < 0 && errno == EEXIST && ::unlink(path.c_str()) == 0)
+                fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+            if(fd < 0)
+                return false;
+
+            bool written = true;
+            while(size > 0) {
+                auto result = ::write(fd, data, size);
+                if(result < 0 && errno == EINTR)
+                    continue;
+                if(result <= 0) {
+                    written = false;
+                    break;
+                }
+                data += result;
+                size -= static_cast<std::size_t>(result);
+            }
+            if(::close(fd) != 0 || !written) {
+                ::unlink(path.c_str());
+                return false;
+            }
+            return true;
+#else
+            std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+            stream.write(data, static_cast<std::streamsize>(size));
+            return static_cast<bool>(stream);
+#endif
+        }
     };
 } // namespace SimpleWeb
 
@@ -1,9 +1,15 @@
 #ifndef SIMPLE_WEB_CRYPTO_HPP
 #define SIMPLE_WEB_CRYPTO_HPP
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <istream>
+#include <memory>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -11,6 +17,7 @@
 #include <openssl/buffer.h>
 #include <openssl/evp.h>
 #include <openssl/md5.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 
 namespace SimpleWeb {
@@ -21,73 +28,184 @@ namespace SimpleWeb {
   }
 #endif
 
+  /// Base64 characters for every 12-bit value, two per entry, so that three input bytes take two lookups
+  constexpr std::array<char, 8192> base64_encode_table() noexcept {
+    constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::array<char, 8192> table{};
+    for(std::size_t c = 0; c < 4096; c++) {
+      table[2 * c] = alphabet[c >> 6];
+      table[2 * c + 1] = alphabet[c & 0x3f];
+    }
+    return table;
+  }
+
+  /// Maps Base64 characters to their 6-bit value, 0xff for characters outside the alphabet
+  constexpr std::array<unsigned char, 256> base64_decode_table() noexcept {
+    std::array<unsigned char, 256> table{};
+    for(auto &value : table)
+      value = 0xff;
+    for(unsigned char c = 0; c < 26; c++) {
+      table['A' + c] = c;
+      table['a' + c] = static_cast<unsigned char>(26 + c);
+    }
+    for(unsigned char c = 0; c < 10; c++)
+      table['0' + c] = static_cast<unsigned char>(52 + c);
+    table['+'] = 62;
+    table['/'] = 63;
+    return table;
+  }
+
   class Crypto {
     const static std::size_t buffer_size = 131072;
 
   public:
+    /// Table-driven Base64 without BIO chains, the only allocation is the returned string
     class Base64 {
     public:
-      /// Returns Base64 encoded string from input string.
-      static std::string encode(const std::string &input) noexcept {
-        std::string base64;
-
-        BIO *bio, *b64;
-        auto bptr = BUF_MEM_new();
-
-        b64 = BIO_new(BIO_f_base64());
-        BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-        bio = BIO_new(BIO_s_mem());
-        BIO_push(b64, bio);
-        BIO_set_mem_buf(b64, bptr, BIO_CLOSE);
-
-        // Write directly to base64-buffer to avoid copy
-        auto base64_length = static_cast<std::size_t>(round(4 * ceil(static_cast<double>(input.size()) / 3.0)));
-        base64.resize(base64_length);
-        bptr->length = 0;
-        bptr->max = base64_length + 1;
-        bptr->data = &base64[0];
-
-        if(BIO_write(b64, &input[0], static_cast<int>(input.size())) <= 0 || BIO_flush(b64) <= 0)
-          base64.clear();
+      /// Number of characters encode() writes for size input bytes.
+      static constexpr std::size_t encoded_size(std::size_t size) noexcept {
+        return (size + 2) / 3 * 4;
+      }
 
-        // To keep &base64[0] through BIO_free_all(b64)
-        bptr->length = 0;
-        bptr->max = 0;
-        bptr->data = nullptr;
+      /// Encodes size bytes into out, which must hold encoded_size(size) characters.
+      static void encode(const unsigned char *in, std::size_t size, char *out) noexcept {
+        static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        static constexpr auto pairs = base64_encode_table();
+
+        std::size_t c = 0;
+        for(; c + 3 <= size; c += 3) {
+          std::uint32_t triple = (static_cast<std::uint32_t>(in[c]) << 16) | (static_cast<std::uint32_t>(in[c + 1]) << 8) | in[c + 2];
+          std::memcpy(out, &pairs[2 * (triple >> 12)], 2);
+          std::memcpy(out + 2, &pairs[2 * (triple & 0xfff)], 2);
+          out += 4;
+        }
+
+        if(c < size) {
+          std::uint32_t triple = static_cast<std::uint32_t>(in[c]) << 16;
+          if(c + 1 < size)
+            triple |= static_cast<std::uint32_t>(in[c + 1]) << 8;
+          *out++ = alphabet[(triple >> 18) & 0x3f];
+          *out++ = alphabet[(triple >> 12) & 0x3f];
+          *out++ = c + 1 < size ? alphabet[(triple >> 6) & 0x3f] : '=';
+          *out++ = '=';
+        }
+      }
 
-        BIO_free_all(b64);
+      /// Decodes size characters into out, which must hold size / 4 * 3 + 2 bytes.
+      /// Returns the number of bytes written, or -1 if the input is not Base64. Padding is optional.
+      static long decode(const char *in, std::size_t size, unsigned char *out) noexcept {
+        static constexpr auto table = base64_decode_table();
+
+        while(size > 0 && in[size - 1] == '=')
+          size--;
+        if(size % 4 == 1)
+          return -1;
+
+        auto begin = out;
+        std::size_t c = 0;
+        for(; c + 4 <= size; c += 4) {
+          auto a = table[static_cast<unsigned char>(in[c])], b = table[static_cast<unsigned char>(in[c + 1])];
+          auto d = table[static_cast<unsigned char>(in[c + 2])], e = table[static_cast<unsigned char>(in[c + 3])];
+          if((a | b | d | e) & 0x80)
+            return -1;
+          std::uint32_t triple = (static_cast<std::uint32_t>(a) << 18) | (static_cast<std::uint32_t>(b) << 12) | (static_cast<std::uint32_t>(d) << 6) | e;
+          *out++ = static_cast<unsigned char>(triple >> 16);
+          *out++ = static_cast<unsigned char>(triple >> 8);
+          *out++ = static_cast<unsigned char>(triple);
+        }
+
+        if(c < size) {
+          std::uint32_t triple = 0;
+          for(std::size_t d = 0; d < size - c; d++) {
+            auto value = table[static_cast<unsigned char>(in[c + d])];
+            if(value & 0x80)
+              return -1;
+            triple |= static_cast<std::uint32_t>(value) << (18 - 6 * d);
+          }
+          *out++ = static_cast<unsigned char>(triple >> 16);
+          if(size - c == 3)
+            *out++ = static_cast<unsigned char>(triple >> 8);
+        }
+
+        return static_cast<long>(out - begin);
+      }
 
+      /// Returns Base64 encoded string from input string.
+      static std::string encode(const std::string &input) noexcept {
+        std::string base64(encoded_size(input.size()), '\0');
+        if(!base64.empty())
+          encode(reinterpret_cast<const unsigned char *>(input.data()), input.size(), &base64[0]);
         return base64;
       }
 
-      /// Returns Base64 decoded string from base64 input.
+      /// Returns Base64 decoded string from base64 input, empty if the input is not Base64.
       static std::string decode(const std::string &base64) noexcept {
-        std::string ascii((6 * base64.size()) / 8, '\0'); // The size is a up to two bytes too large.
-
-        BIO *b64, *bio;
-
-        b64 = BIO_new(BIO_f_base64());
-        BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-// TODO: Remove in 2022 or later
-#if(defined(OPENSSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER < 0x1000214fL) || (defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x2080000fL)
-        bio = BIO_new_mem_buf(const_cast<char *>(&base64[0]), static_cast<int>(base64.size()));
-#else
-        bio = BIO_new_mem_buf(&base64[0], static_cast<int>(base64.size()));
-#endif
-        bio = BIO_push(b64, bio);
-
-        auto decoded_length = BIO_read(bio, &ascii[0], static_cast<int>(ascii.size()));
+        std::string ascii(base64.size() / 4 * 3 + 2, '\0');
+        auto decoded_length = decode(base64.data(), base64.size(), reinterpret_cast<unsigned char *>(&ascii[0]));
         if(decoded_length > 0)
           ascii.resize(static_cast<std::size_t>(decoded_length));
         else
           ascii.clear();
-
-        BIO_free_all(b64);
-
         return ascii;
       }
+
     };
 
+    /// Returns the Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+    static std::string websocket_accept(const std::string &key) noexcept {
+      static constexpr char ws_magic_string[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+      constexpr std::size_t magic_size = sizeof(ws_magic_string) - 1;
+
+      // Keys are 24 characters, longer ones are handled but don't fit on the stack
+      std::array<char, 128> input;
+      std::string long_input;
+      const char *data = input.data();
+      if(key.size() + magic_size <= input.size()) {
+        std::memcpy(input.data(), key.data(), key.size());
+        std::memcpy(input.data() + key.size(), ws_magic_string, magic_size);
+      }
+      else {
+        long_input = key + ws_magic_string;
+        data = long_input.data();
+      }
+
+      // The one-shot digest needs no EVP context, so nothing is allocated besides the result
+      std::array<unsigned char, SHA_DIGEST_LENGTH> digest;
+      ::SHA1(reinterpret_cast<const unsigned char *>(data), key.size() + magic_size, digest.data());
+      std::string accept(Base64::encoded_size(digest.size()), '\0');
+      Base64::encode(digest.data(), digest.size(), &accept[0]);
+      return accept;
+    }
+
+    /// Fills out with cryptographically secure random bytes, e.g. for frame masks and handshake nonces.
+    /// Bytes are served from a per-thread buffer refilled from the OpenSSL DRBG, which reseeds itself periodically,
+    /// so small requests cost a copy instead of a system call.
+    static void random_bytes(unsigned char *out, std::size_t size) noexcept {
+      thread_local std::array<unsigned char, 512> buffer;
+      thread_local std::size_t available = 0;
+
+      while(size > 0) {
+        if(available == 0) {
+          if(RAND_bytes(buffer.data(), static_cast<int>(buffer.size())) != 1) {
+            std::random_device rd;
+            std::uniform_int_distribution<unsigned short> dist(0, 255);
+            for(auto &byte : buffer)
+              byte = static_cast<unsigned char>(dist(rd));
+          }
+          available = buffer.size();
+        }
+
+        auto count = (std::min)(size, available);
+        auto begin = buffer.data() + buffer.size() - available;
+        std::memcpy(out, begin, count);
+        // Served bytes are not kept around
+        std::memset(begin, 0, count);
+        available -= count;
+        out += count;
+        size -= count;
+      }
+    }
+
     /// Returns hex string from bytes in input string.
     static std::string to_hex_string(const std::string &input) noexcept {
       std::stringstream hex_stream;
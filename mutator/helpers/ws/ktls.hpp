@@ -0,0 +1,249 @@
+#ifndef SIMPLE_WEB_KTLS_HPP
+#define SIMPLE_WEB_KTLS_HPP
+
+#include "asio_compatibility.hpp"
+#include <cstring>
+#include <string>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+
+#ifdef ASIO_STANDALONE
+#include <asio/ssl.hpp>
+#else
+#include <boost/asio/ssl.hpp>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#if defined(TLS_1_3_VERSION) && defined(TLS_CIPHER_AES_GCM_256)
+#define SIMPLE_WEB_KTLS 1
+#endif
+#endif
+
+namespace SimpleWeb {
+  /// Hands record encryption of an established TLS 1.3 connection to the Linux kernel (kTLS), for the sending direction only.
+  /// asio::ssl::stream runs OpenSSL on a memory BIO pair, so SSL_OP_ENABLE_KTLS never takes effect on it. Instead the
+  /// traffic secret is picked up through the key log callback and the kernel is given the record key derived from it.
+  /// Afterwards writes go to the TCP socket directly while reads still go through OpenSSL. Records OpenSSL would still send
+  /// on its own (KeyUpdate replies, alerts) are dropped, see install().
+  /// Connections the kernel can't take over (no tls module, TLS 1.2, ChaCha20-Poly1305) keep using OpenSSL for both directions.
+  class KernelTLS {
+  public:
+    /// Prepares the context, call before connections are made. Servers stop issuing session tickets:
+    /// tickets are records sent with the same key, so they would put the kernel's record sequence number out of step.
+    /// A key log callback already set on the context keeps receiving every line.
+    static void prepare(asio::ssl::context &context, bool server) noexcept {
+#ifdef SIMPLE_WEB_KTLS
+      auto previous = SSL_CTX_get_keylog_callback(context.native_handle());
+      if(previous != keylog) {
+        if(previous) {
+          auto chained = new(std::nothrow) ChainedKeylog{previous};
+          if(!chained || !SSL_CTX_set_ex_data(context.native_handle(), chained_index(), chained)) {
+            delete chained;
+            return;
+          }
+        }
+        SSL_CTX_set_keylog_callback(context.native_handle(), keylog);
+      }
+      if(server)
+        SSL_CTX_set_num_tickets(context.native_handle(), 0);
+#else
+      (void)context;
+      (void)server;
+#endif
+    }
+
+    /// Returns true if the kernel encrypts everything sent on fd from now on.
+    /// Call right after the handshake has completed, before any application data is sent.
+    static bool enable_send(SSL *ssl, int fd) noexcept {
+#ifdef SIMPLE_WEB_KTLS
+      auto secret = static_cast<Secret *>(SSL_get_ex_data(ssl, secret_index()));
+      if(!secret)
+        return false;
+
+      auto result = install(ssl, fd, *secret);
+      OPENSSL_cleanse(secret, sizeof(Secret));
+      return result;
+#else
+      (void)ssl;
+      (void)fd;
+      return false;
+#endif
+    }
+
+#ifdef SIMPLE_WEB_KTLS
+  private:
+    struct Secret {
+      unsigned char data[EVP_MAX_MD_SIZE];
+      std::size_t size = 0;
+    };
+
+    static int secret_index() noexcept {
+      static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, [](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+        if(ptr) {
+          OPENSSL_cleanse(ptr, sizeof(Secret));
+          delete static_cast<Secret *>(ptr);
+        }
+      });
+      return index;
+    }
+
+    struct ChainedKeylog {
+      SSL_CTX_keylog_cb_func callback;
+    };
+
+    static int chained_index() noexcept {
+      static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, [](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+        delete static_cast<ChainedKeylog *>(ptr);
+      });
+      return index;
+    }
+
+    static int hex_value(char chr) noexcept {
+      if(chr >= '0' && chr <= '9')
+        return chr - '0';
+      if(chr >= 'a' && chr <= 'f')
+        return chr - 'a' + 10;
+      if(chr >= 'A' && chr <= 'F')
+        return chr - 'A' + 10;
+      return -1;
+    }
+
+    /// Lines have the form "<label> <client random> <secret>", only the first sending secret is kept
+    static void keylog(const SSL *ssl, const char *line) noexcept {
+      if(auto chained = static_cast<ChainedKeylog *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), chained_index())))
+        chained->callback(ssl, line);
+
+      const char *label = SSL_is_server(ssl) ? "SERVER_TRAFFIC_SECRET_0 " : "CLIENT_TRAFFIC_SECRET_0 ";
+      auto label_size = std::strlen(label);
+      if(std::strncmp(line, label, label_size) != 0)
+        return;
+
+      auto hex = std::strchr(line + label_size, ' ');
+      if(!hex)
+        return;
+      ++hex;
+
+      auto hex_size = std::strlen(hex);
+      if(hex_size % 2 != 0 || hex_size / 2 > EVP_MAX_MD_SIZE)
+        return;
+
+      auto secret = new(std::nothrow) Secret();
+      if(!secret)
+        return;
+      for(std::size_t c = 0; c < hex_size / 2; ++c) {
+        auto high = hex_value(hex[c * 2]), low = hex_value(hex[c * 2 + 1]);
+        if(high < 0 || low < 0) {
+          delete secret;
+          return;
+        }
+        secret->data[c] = static_cast<unsigned char>(high << 4 | low);
+      }
+      secret->size = hex_size / 2;
+
+      auto mutable_ssl = const_cast<SSL *>(ssl);
+      if(auto previous = static_cast<Secret *>(SSL_get_ex_data(mutable_ssl, secret_index()))) {
+        OPENSSL_cleanse(previous, sizeof(Secret));
+        delete previous;
+      }
+      SSL_set_ex_data(mutable_ssl, secret_index(), secret);
+    }
+
+    /// HKDF-Expand-Label from RFC 8446 section 7.1 with an empty context, out_size never exceeds one hash block
+    static bool expand_label(const EVP_MD *md, const Secret &secret, const char *label, unsigned char *out, std::size_t out_size) noexcept {
+      unsigned char info[32];
+      std::size_t info_size = 0;
+      auto label_size = std::strlen(label);
+      info[info_size++] = static_cast<unsigned char>(out_size >> 8);
+      info[info_size++] = static_cast<unsigned char>(out_size);
+      info[info_size++] = static_cast<unsigned char>(6 + label_size);
+      std::memcpy(info + info_size, "tls13 ", 6);
+      info_size += 6;
+      std::memcpy(info + info_size, label, label_size);
+      info_size += label_size;
+      info[info_size++] = 0; // Context length
+      info[info_size++] = 1; // HKDF-Expand block counter
+
+      unsigned char block[EVP_MAX_MD_SIZE];
+      unsigned int block_size = 0;
+      if(!HMAC(md, secret.data, static_cast<int>(secret.size), info, info_size, block, &block_size) || block_size < out_size)
+        return false;
+
+      std::memcpy(out, block, out_size);
+      OPENSSL_cleanse(block, sizeof(block));
+      return true;
+    }
+
+    template <typename crypto_info_type>
+    static bool set_send_key(int fd, unsigned short cipher_type, const unsigned char *key, const unsigned char *iv) noexcept {
+      crypto_info_type info;
+      std::memset(&info, 0, sizeof(info));
+      info.info.version = TLS_1_3_VERSION;
+      info.info.cipher_type = cipher_type;
+      std::memcpy(info.key, key, sizeof(info.key));
+      std::memcpy(info.salt, iv, sizeof(info.salt));
+      std::memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+      // No record has been sent with this key yet, rec_seq stays 0
+      auto result = setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+      OPENSSL_cleanse(&info, sizeof(info));
+      return result == 0;
+    }
+
+    static bool install(SSL *ssl, int fd, const Secret &secret) noexcept {
+      if(SSL_version(ssl) != TLS1_3_VERSION)
+        return false;
+
+      auto cipher = SSL_get_current_cipher(ssl);
+      if(!cipher)
+        return false;
+      auto cipher_id = SSL_CIPHER_get_id(cipher) & 0xffff;
+      // TLS_AES_128_GCM_SHA256 and TLS_AES_256_GCM_SHA384
+      if(cipher_id != 0x1301 && cipher_id != 0x1302)
+        return false;
+      auto md = SSL_CIPHER_get_handshake_digest(cipher);
+      if(!md || static_cast<std::size_t>(EVP_MD_size(md)) != secret.size)
+        return false;
+
+      // Records OpenSSL writes itself from here on would be encrypted a second time by the kernel, so they go to a null BIO.
+      // A KeyUpdate reply is dropped that way too, the peer keeps accepting the current key until it sees one.
+      auto null_bio = BIO_new(BIO_s_null());
+      if(!null_bio)
+        return false;
+
+      std::size_t key_size = cipher_id == 0x1301 ? 16 : 32;
+      unsigned char key[32], iv[12];
+      bool result = false;
+      if(expand_label(md, secret, "key", key, key_size) && expand_label(md, secret, "iv", iv, sizeof(iv)) &&
+         setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0) {
+        // Until TLS_TX is set the socket still sends plain data, so a failure here leaves it usable
+        if(cipher_id == 0x1301)
+          result = set_send_key<tls12_crypto_info_aes_gcm_128>(fd, TLS_CIPHER_AES_GCM_128, key, iv);
+        else
+          result = set_send_key<tls12_crypto_info_aes_gcm_256>(fd, TLS_CIPHER_AES_GCM_256, key, iv);
+      }
+
+      OPENSSL_cleanse(key, sizeof(key));
+      OPENSSL_cleanse(iv, sizeof(iv));
+
+      // The read side of the BIO pair stays in place, so incoming records still reach OpenSSL
+      if(result)
+        SSL_set0_wbio(ssl, null_bio);
+      else
+        BIO_free(null_bio);
+      return result;
+    }
+#endif
+  };
+} // namespace SimpleWeb
+
+#endif /* SIMPLE_WEB_KTLS_HPP */
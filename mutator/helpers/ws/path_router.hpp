@@ -0,0 +1,138 @@
+#ifndef SIMPLE_WEB_PATH_ROUTER_HPP
+#define SIMPLE_WEB_PATH_ROUTER_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SimpleWeb {
+  /// Matches request paths against endpoint patterns without running a regex.
+  /// Patterns that are plain literals ("^/path$", "^/path/?$") become exact routes and
+  /// patterns ending with ".*" become prefix routes stored in a trie. Any other pattern is rejected
+  /// by add() and has to be matched by the caller as a regex.
+  class PathRouter {
+  public:
+    static constexpr std::size_t npos = (std::numeric_limits<std::size_t>::max)();
+
+    PathRouter() noexcept : nodes(1) {}
+
+    void clear() noexcept {
+      exact.clear();
+      nodes.assign(1, Node());
+    }
+
+    /// Adds a route with the given index, lower indices win if several routes match.
+    /// Returns false if the pattern is not a literal or a literal prefix.
+    bool add(const std::string &pattern, std::size_t index) {
+      std::string literal;
+      auto kind = parse(pattern, literal);
+      switch(kind) {
+      case Kind::exact:
+        add_exact(literal, index);
+        return true;
+      case Kind::exact_optional_slash:
+        add_exact(literal, index);
+        add_exact(literal + '/', index);
+        return true;
+      case Kind::prefix: {
+        std::uint32_t node = 0;
+        for(auto chr : literal) {
+          auto it = nodes[node].children.find(chr);
+          if(it == nodes[node].children.end()) {
+            nodes.emplace_back();
+            it = nodes[node].children.emplace(chr, static_cast<std::uint32_t>(nodes.size() - 1)).first;
+          }
+          node = it->second;
+        }
+        nodes[node].index = (std::min)(nodes[node].index, index);
+        return true;
+      }
+      case Kind::regex:
+        break;
+      }
+      return false;
+    }
+
+    /// Returns the lowest index of all routes matching path, or npos.
+    std::size_t match(const std::string &path) const noexcept {
+      std::size_t result = npos;
+
+      auto it = exact.find(path);
+      if(it != exact.end())
+        result = it->second;
+
+      std::uint32_t node = 0;
+      for(std::size_t c = 0;; c++) {
+        result = (std::min)(result, nodes[node].index);
+        if(c == path.size())
+          break;
+        auto child = nodes[node].children.find(path[c]);
+        if(child == nodes[node].children.end())
+          break;
+        node = child->second;
+      }
+
+      return result;
+    }
+
+  private:
+    enum class Kind { exact,
+                      exact_optional_slash,
+                      prefix,
+                      regex };
+
+    struct Node {
+      std::unordered_map<char, std::uint32_t> children;
+      std::size_t index = npos;
+    };
+
+    std::unordered_map<std::string, std::size_t> exact;
+    std::vector<Node> nodes;
+
+    void add_exact(const std::string &path, std::size_t index) {
+      auto it = exact.emplace(path, index).first;
+      it->second = (std::min)(it->second, index);
+    }
+
+    /// Patterns are always matched in full, so leading ^ and trailing $ don't change them
+    static Kind parse(std::string pattern, std::string &literal) {
+      if(!pattern.empty() && pattern.front() == '^')
+        pattern.erase(0, 1);
+      if(!pattern.empty() && pattern.back() == '$' && (pattern.size() < 2 || pattern[pattern.size() - 2] != '\\'))
+        pattern.pop_back();
+
+      auto kind = Kind::exact;
+      if(pattern.size() >= 2 && pattern.compare(pattern.size() - 2, 2, ".*") == 0 && (pattern.size() < 3 || pattern[pattern.size() - 3] != '\\')) {
+        kind = Kind::prefix;
+        pattern.resize(pattern.size() - 2);
+      }
+      else if(pattern.size() >= 2 && pattern.compare(pattern.size() - 2, 2, "/?") == 0 && (pattern.size() < 3 || pattern[pattern.size() - 3] != '\\')) {
+        kind = Kind::exact_optional_slash;
+        pattern.resize(pattern.size() - 2);
+      }
+
+      static const std::string special = ".[]{}()*+?|^$\\";
+      literal.clear();
+      for(std::size_t c = 0; c < pattern.size(); c++) {
+        auto chr = pattern[c];
+        if(chr == '\\') {
+          // Only escaped punctuation is a literal, \d, \w and the like are character classes
+          if(c + 1 == pattern.size() || std::isalnum(static_cast<unsigned char>(pattern[c + 1])))
+            return Kind::regex;
+          literal += pattern[++c];
+        }
+        else if(special.find(chr) != std::string::npos)
+          return Kind::regex;
+        else
+          literal += chr;
+      }
+      return kind;
+    }
+  };
+} // namespace SimpleWeb
+
+#endif /* SIMPLE_WEB_PATH_ROUTER_HPP */
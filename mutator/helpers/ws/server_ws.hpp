@@ -4,7 +4,11 @@
 #include "asio_compatibility.hpp"
 #include "crypto.hpp"
 #include "mutex.hpp"
+#include "path_router.hpp"
+#include "timer_wheel.hpp"
+#include "transport_stats.hpp"
 #include "utility.hpp"
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <iostream>
@@ -14,6 +18,11 @@
 #include <thread>
 #include <unordered_set>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 // Late 2017 TODO: remove the following checks and always use std::regex
 #ifdef USE_BOOST_REGEX
 #include <boost/regex.hpp>
@@ -85,6 +94,8 @@ namespace SimpleWeb {
 
       CaseInsensitiveMultimap header;
 
+      /// Set for endpoints matched as a regex. Literal ("^/path/?$") and prefix ("^/path/.*$") endpoints are matched
+      /// without running the regex and leave it empty, they have no groups to capture and path holds the full path.
       regex::smatch path_match;
 
     private:
@@ -103,52 +114,75 @@ namespace SimpleWeb {
       long timeout_idle;
 
       Mutex timer_mutex;
-      std::unique_ptr<asio::steady_timer> timer GUARDED_BY(timer_mutex);
+      std::shared_ptr<TimerWheel::Entry> timer_entry GUARDED_BY(timer_mutex);
+      TimerWheel *timer_wheel GUARDED_BY(timer_mutex) = nullptr;
 
       std::atomic<bool> close_sent;
 
+      /// Set right after the TLS handshake if the kernel encrypts outgoing records, writes then bypass the TLS stream
+      bool kernel_tls = false;
+
+      TransportCounters counters;
+
       asio::ip::tcp::endpoint endpoint; // The endpoint is read in SocketServer::write_handshake and must be stored so that it can be read reliably in all handlers, including on_error
 
       void set_timeout(long seconds = -1) noexcept {
         if(seconds == -1)
           seconds = timeout_idle;
 
-        LockGuard lock(timer_mutex);
+        // Rearming is the common case and only updates the entry's deadline in the context's timer wheel
+        std::shared_ptr<TimerWheel::Entry> entry;
+        TimerWheel *wheel;
+        try {
+          LockGuard lock(timer_mutex);
+          if(!timer_entry) {
+            if(seconds == 0)
+              return;
 
-        if(seconds == 0) {
-          timer = nullptr;
+            std::weak_ptr<Connection> connection_weak(this->shared_from_this()); // To avoid keeping Connection instance alive longer than needed
+            timer_entry = std::make_shared<TimerWheel::Entry>([connection_weak] {
+              if(auto connection = connection_weak.lock())
+                connection->close(); // Servers are not required to send close frames
+            });
+            timer_wheel = &TimerWheel::get(socket->lowest_layer());
+          }
+          entry = timer_entry;
+          wheel = timer_wheel;
+        }
+        catch(...) {
           return;
         }
 
-        timer = make_steady_timer(*socket, std::chrono::seconds(seconds));
-        std::weak_ptr<Connection> connection_weak(this->shared_from_this()); // To avoid keeping Connection instance alive longer than needed
-        timer->async_wait([connection_weak](const error_code &ec) {
-          if(!ec) {
-            if(auto connection = connection_weak.lock())
-              connection->close(); // Servers are not required to send close frames
-          }
-        });
+        try {
+          wheel->set(entry, seconds);
+        }
+        catch(...) {
+        }
       }
 
       void cancel_timeout() noexcept {
         LockGuard lock(timer_mutex);
-        if(timer) {
-          try {
-            timer->cancel();
-          }
-          catch(...) {
-          }
-        }
+        if(timer_entry)
+          timer_wheel->cancel(*timer_entry);
+      }
+
+      template <typename buffers_type, typename handler_type>
+      void async_write(buffers_type &&buffers, handler_type &&handler) {
+        if(kernel_tls)
+          asio::async_write(static_cast<asio::ip::tcp::socket &>(socket->lowest_layer()), std::forward<buffers_type>(buffers), std::forward<handler_type>(handler));
+        else
+          asio::async_write(*socket, std::forward<buffers_type>(buffers), std::forward<handler_type>(handler));
       }
 
       class OutData {
       public:
         OutData(std::shared_ptr<OutMessage> out_header_, std::shared_ptr<OutMessage> out_message_,
                 std::function<void(const error_code)> &&callback_) noexcept
-            : out_header(std::move(out_header_)), out_message(std::move(out_message_)), callback(std::move(callback_)) {}
+            : out_header(std::move(out_header_)), out_message(std::move(out_message_)), callback(std::move(callback_)), queued_at(std::chrono::steady_clock::now()) {}
         std::shared_ptr<OutMessage> out_header;
         std::shared_ptr<OutMessage> out_message;
         std::function<void(const error_code)> callback;
+        std::chrono::steady_clock::time_point queued_at;
       };
 
       Mutex send_queue_mutex;
@@ -157,9 +191,10 @@ namespace SimpleWeb {
       /// send_queue_mutex must be locked here
       void send_from_queue() REQUIRES(send_queue_mutex) {
         std::array<asio::const_buffer, 2> buffers{send_queue.begin()->out_header->streambuf.data(), send_queue.begin()->out_message->streambuf.data()};
+        counters.write_started(send_queue.begin()->queued_at);
         auto self = this->shared_from_this();
         set_timeout();
-        asio::async_write(*socket, buffers, [self](const error_code &ec, std::size_t /*bytes_transferred*/) {
+        async_write(buffers, [self](const error_code &ec, std::size_t bytes_transferred) {
           self->set_timeout(); // Set timeout for next send
           auto lock = self->handler_runner->continue_lock();
           if(!lock)
@@ -167,6 +202,8 @@ namespace SimpleWeb {
           {
             LockGuard lock(self->send_queue_mutex);
             if(!ec) {
+              self->counters.frame_sent(bytes_transferred);
+              self->counters.messages_dequeued(1);
               auto it = self->send_queue.begin();
               auto callback = std::move(it->callback);
               self->send_queue.erase(it);
@@ -184,6 +221,7 @@ namespace SimpleWeb {
                 if(out_data.callback)
                   callbacks.emplace_back(std::move(out_data.callback));
               }
+              self->counters.messages_dequeued(self->send_queue.size());
               self->send_queue.clear();
 
               lock.unlock();
@@ -223,6 +261,7 @@ namespace SimpleWeb {
 
         LockGuard lock(send_queue_mutex);
         send_queue.emplace_back(std::move(out_header), std::move(out_message), std::move(callback));
+        counters.message_queued();
         if(send_queue.size() == 1)
           send_from_queue();
       }
@@ -264,6 +303,11 @@ namespace SimpleWeb {
         return endpoint;
       }
 
+      /// Counters of this connection, SocketServerBase::transport_stats() has the totals of all connections
+      TransportStats transport_stats() const noexcept {
+        return counters.snapshot();
+      }
+
       asio::ip::tcp::endpoint local_endpoint() const noexcept {
         try {
           if(auto connection = this->connection.lock())
@@ -346,6 +390,18 @@ namespace SimpleWeb {
       bool reuse_address = true;
       /// Make use of RFC 7413 or TCP Fast Open (TFO)
       bool fast_open = false;
+      /// Number of acceptors bound to the same port with SO_REUSEPORT, each with its own io_context run by a single thread,
+      /// so that a connection stays on the thread that accepted it. Replaces thread_pool_size when above 1.
+      /// Only used if io_service is not set, and only where SO_REUSEPORT is available. Defaults to 0, a single shared acceptor.
+      std::size_t acceptor_shards = 0;
+      /// Pin the thread of every acceptor shard to its own core. Linux only.
+      bool pin_shard_threads = true;
+      /// Let the kernel encrypt outgoing records of TLS 1.3 connections (kTLS), falls back to OpenSSL where unavailable.
+      /// Disables session tickets. Linux and WSS only.
+      bool kernel_tls = false;
+      /// Path answered with transport_stats() in the Prometheus text format, for instance "/metrics".
+      /// Only plain HTTP GET requests are answered there, websocket handshakes are routed as usual. Defaults to no such path.
+      std::string metrics_path;
     };
     /// Set before calling start().
     Config config;
@@ -363,7 +419,9 @@ namespace SimpleWeb {
     };
 
   public:
-    /// Warning: do not add or remove endpoints after start() is called
+    /// Warning: endpoints are compiled into routes once, by start() or by the first handshake if that comes earlier.
+    /// Endpoints added or removed afterwards are not picked up.
+    /// Literal ("^/path/?$") and prefix ("^/path/.*$") patterns are matched without running the regex.
     std::map<regex_orderable, Endpoint> endpoint;
 
     /// Start the server.
@@ -373,6 +431,8 @@ namespace SimpleWeb {
     void start(const std::function<void(unsigned short /*port*/)> &callback = nullptr) {
       std::unique_lock<std::mutex> lock(start_stop_mutex);
 
+      compile_routes();
+
       asio::ip::tcp::endpoint endpoint;
       if(!config.address.empty())
         endpoint = asio::ip::tcp::endpoint(make_address(config.address), config.port);
@@ -384,6 +444,12 @@ namespace SimpleWeb {
         internal_io_service = true;
       }
 
+      std::size_t shard_count = 1;
+#ifdef SO_REUSEPORT
+      if(internal_io_service)
+        shard_count = (std::max<std::size_t>)(config.acceptor_shards, 1);
+#endif
+
       if(!acceptor)
         acceptor = std::unique_ptr<asio::ip::tcp::acceptor>(new asio::ip::tcp::acceptor(*io_service));
       try {
@@ -397,14 +463,7 @@ namespace SimpleWeb {
         else
           throw;
       }
-      acceptor->set_option(asio::socket_base::reuse_address(config.reuse_address));
-      if(config.fast_open) {
-#if defined(__linux__) && defined(TCP_FASTOPEN)
-        const int qlen = 5; // This seems to be the value that is used in other examples.
-        error_code ec;
-        acceptor->set_option(asio::detail::socket_option::integer<IPPROTO_TCP, TCP_FASTOPEN>(qlen), ec);
-#endif // End Linux
-      }
+      set_acceptor_options(*acceptor, shard_count > 1);
       acceptor->bind(endpoint);
 
       after_bind();
@@ -412,7 +471,22 @@ namespace SimpleWeb {
       auto port = acceptor->local_endpoint().port();
 
       acceptor->listen();
-      accept();
+      accept(*io_service, *acceptor);
+
+      // The remaining shards bind to the port the first acceptor got, which matters when config.port is 0
+      shards.clear();
+      endpoint.port(port);
+      for(std::size_t c = 1; c < shard_count; c++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->io_service = std::make_shared<io_context>();
+        shard->acceptor = std::unique_ptr<asio::ip::tcp::acceptor>(new asio::ip::tcp::acceptor(*shard->io_service));
+        shard->acceptor->open(endpoint.protocol());
+        set_acceptor_options(*shard->acceptor, true);
+        shard->acceptor->bind(endpoint);
+        shard->acceptor->listen();
+        accept(*shard->io_service, *shard->acceptor);
+        shards.emplace_back(std::move(shard));
+      }
 
       if(internal_io_service && io_service->stopped())
         restart(*io_service);
@@ -423,18 +497,43 @@ namespace SimpleWeb {
         });
 
       if(internal_io_service) {
-        // If thread_pool_size>1, start m_io_service.run() in (thread_pool_size-1) threads for thread-pooling
         threads.clear();
-        for(std::size_t c = 1; c < config.thread_pool_size; c++) {
-          threads.emplace_back([this]() {
-            this->io_service->run();
-          });
+        if(shard_count > 1) {
+          // One thread per shard, the first shard runs on the main thread
+          for(std::size_t c = 1; c < shard_count; c++) {
+            auto shard_io_service = shards[c - 1]->io_service;
+            threads.emplace_back([this, shard_io_service, c]() {
+              pin_shard_thread(c);
+              shard_io_service->run();
+            });
+          }
+        }
+        else {
+          // If thread_pool_size>1, start m_io_service.run() in (thread_pool_size-1) threads for thread-pooling
+          for(std::size_t c = 1; c < config.thread_pool_size; c++) {
+            threads.emplace_back([this]() {
+              this->io_service->run();
+            });
+          }
         }
 
         lock.unlock();
 
         // Main thread
-        if(config.thread_pool_size > 0)
+        if(shard_count > 1) {
+          // The caller's thread serves shard 0, and gets its own affinity back once the server is stopped
+#if defined(__linux__)
+          cpu_set_t caller_cpu_set;
+          auto saved_affinity = pthread_getaffinity_np(pthread_self(), sizeof(caller_cpu_set), &caller_cpu_set) == 0;
+#endif
+          pin_shard_thread(0);
+          io_service->run();
+#if defined(__linux__)
+          if(saved_affinity)
+            pthread_setaffinity_np(pthread_self(), sizeof(caller_cpu_set), &caller_cpu_set);
+#endif
+        }
+        else if(config.thread_pool_size > 0)
           io_service->run();
 
         lock.lock();
@@ -452,6 +551,8 @@ namespace SimpleWeb {
       if(acceptor) {
         error_code ec;
         acceptor->close(ec);
+        for(auto &shard : shards)
+          shard->acceptor->close(ec);
 
         for(auto &pair : endpoint) {
           LockGuard lock(pair.second.connections_mutex);
@@ -460,8 +561,11 @@ namespace SimpleWeb {
           pair.second.connections.clear();
         }
 
-        if(internal_io_service)
+        if(internal_io_service) {
           io_service->stop();
+          for(auto &shard : shards)
+            shard->io_service->stop();
+        }
       }
     }
 
@@ -470,11 +574,18 @@ namespace SimpleWeb {
       if(acceptor) {
         error_code ec;
         acceptor->close(ec);
+        for(auto &shard : shards)
+          shard->acceptor->close(ec);
       }
     }
 
     virtual ~SocketServerBase() noexcept {}
 
+    /// Totals of all connections handled so far, Connection::transport_stats() has the counters of a single connection
+    TransportStats transport_stats() const noexcept {
+      return counters->snapshot();
+    }
+
     std::unordered_set<std::shared_ptr<Connection>> get_connections() noexcept {
       std::unordered_set<std::shared_ptr<Connection>> all_connections;
       for(auto &e : endpoint) {
@@ -518,12 +629,60 @@ namespace SimpleWeb {
     std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
     std::vector<std::thread> threads;
 
+    /// Additional acceptors when config.acceptor_shards is above 1, each with its own io_context
+    struct Shard {
+      std::shared_ptr<io_context> io_service;
+      std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
+    };
+    std::vector<std::unique_ptr<Shard>> shards;
+
     std::shared_ptr<ScopeRunner> handler_runner;
 
+    std::shared_ptr<TransportCounters> counters = std::make_shared<TransportCounters>();
+
+    /// Endpoints in map order, the router and the regex fallbacks refer to them by index
+    std::vector<std::pair<const regex_orderable *, Endpoint *>> routes;
+    std::vector<std::size_t> regex_routes;
+    PathRouter router;
+    std::atomic<bool> routes_compiled{false};
+    std::mutex routes_mutex;
+
     SocketServerBase(unsigned short port) noexcept : config(port), handler_runner(new ScopeRunner()) {}
 
     virtual void after_bind() {}
-    virtual void accept() = 0;
+    /// Accepts connections on the given acceptor, connections are run by the acceptor's io_context
+    virtual void accept(io_context &acceptor_io_service, asio::ip::tcp::acceptor &shard_acceptor) = 0;
+
+    void set_acceptor_options(asio::ip::tcp::acceptor &shard_acceptor, bool reuse_port) {
+      shard_acceptor.set_option(asio::socket_base::reuse_address(config.reuse_address));
+#ifdef SO_REUSEPORT
+      if(reuse_port)
+        shard_acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+      (void)reuse_port;
+#endif
+      if(config.fast_open) {
+#if defined(__linux__) && defined(TCP_FASTOPEN)
+        const int qlen = 5; // This seems to be the value that is used in other examples.
+        error_code ec;
+        shard_acceptor.set_option(asio::detail::socket_option::integer<IPPROTO_TCP, TCP_FASTOPEN>(qlen), ec);
+#endif // End Linux
+      }
+    }
+
+    void pin_shard_thread(std::size_t shard) noexcept {
+#if defined(__linux__)
+      auto cores = std::thread::hardware_concurrency();
+      if(!config.pin_shard_threads || cores == 0)
+        return;
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(shard % cores, &cpu_set);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+      (void)shard;
+#endif
+    }
 
     void read_handshake(const std::shared_ptr<Connection> &connection) {
       connection->set_timeout(config.timeout_request);
@@ -540,64 +699,126 @@ namespace SimpleWeb {
       });
     }
 
+    /// Handshakes on several io threads may get here at once, the routes are built by the first one only
+    void compile_routes() {
+      if(routes_compiled.load(std::memory_order_acquire))
+        return;
+      std::lock_guard<std::mutex> lock(routes_mutex);
+      if(routes_compiled.load(std::memory_order_relaxed))
+        return;
+      routes.clear();
+      regex_routes.clear();
+      router.clear();
+      for(auto &pair : endpoint) {
+        if(!router.add(pair.first.str, routes.size()))
+          regex_routes.emplace_back(routes.size());
+        routes.emplace_back(&pair.first, &pair.second);
+      }
+      routes_compiled.store(true, std::memory_order_release);
+    }
+
+    /// Returns the first endpoint in map order matching the path, as the regex only loop did
+    std::size_t find_route(const std::string &path, regex::smatch &path_match) {
+      // Connections upgraded from another server may arrive without start() being called
+      compile_routes();
+
+      auto index = router.match(path);
+      for(auto regex_index : regex_routes) {
+        if(regex_index > index)
+          break;
+        if(regex::regex_match(path, path_match, *routes[regex_index].first))
+          return regex_index;
+      }
+      // Only a pattern with groups is worth running the regex for, see Connection::path_match
+      if(index != PathRouter::npos && routes[index].first->mark_count() > 0)
+        regex::regex_match(path, path_match, *routes[index].first);
+      return index;
+    }
+
     void write_handshake(const std::shared_ptr<Connection> &connection) {
-      for(auto &regex_endpoint : endpoint) {
-        regex::smatch path_match;
-        if(regex::regex_match(connection->path, path_match, regex_endpoint.first)) {
-          auto streambuf = std::make_shared<asio::streambuf>();
-          std::ostream ostream(streambuf.get());
-
-          StatusCode status_code = StatusCode::information_switching_protocols;
-          auto key_it = connection->header.find("Sec-WebSocket-Key");
-          if(key_it == connection->header.end())
-            status_code = StatusCode::client_error_upgrade_required;
-          else {
-            CaseInsensitiveMultimap response_header = config.header;
-            response_header.emplace("Upgrade", "websocket");
-            response_header.emplace("Connection", "Upgrade");
-            static auto ws_magic_string = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-            auto sha1 = Crypto::sha1(key_it->second + ws_magic_string);
-            response_header.emplace("Sec-WebSocket-Accept", Crypto::Base64::encode(sha1));
-
-            try {
-              connection->endpoint = connection->socket->lowest_layer().remote_endpoint();
-            }
-            catch(...) {
-            }
+      connection->counters.parent = counters;
+      if(!config.metrics_path.empty() && connection->path == config.metrics_path && connection->header.find("Sec-WebSocket-Key") == connection->header.end()) {
+        write_metrics(connection);
+        return;
+      }
 
-            if(regex_endpoint.second.on_handshake)
-              status_code = regex_endpoint.second.on_handshake(connection, response_header);
+      regex::smatch path_match;
+      auto route_index = find_route(connection->path, path_match);
+      if(route_index == PathRouter::npos)
+        return;
 
-            if(status_code == StatusCode::information_switching_protocols) {
-              ostream << "HTTP/1.1 101 Web Socket Protocol Handshake\r\n";
-              for(auto &header_field : response_header)
-                ostream << header_field.first << ": " << header_field.second << "\r\n";
-              ostream << "\r\n";
-            }
-          }
-          if(status_code != StatusCode::information_switching_protocols)
-            ostream << "HTTP/1.1 " + SimpleWeb::status_code(status_code) + "\r\n\r\n";
-
-          connection->path_match = std::move(path_match);
-          connection->set_timeout(config.timeout_request);
-          asio::async_write(*connection->socket, *streambuf, [this, connection, streambuf, &regex_endpoint, status_code](const error_code &ec, std::size_t /*bytes_transferred*/) {
-            connection->cancel_timeout();
-            auto lock = connection->handler_runner->continue_lock();
-            if(!lock)
-              return;
-            if(status_code != StatusCode::information_switching_protocols)
-              return;
+      auto &route_endpoint = *routes[route_index].second;
+      auto streambuf = std::make_shared<asio::streambuf>();
+      std::ostream ostream(streambuf.get());
 
-            if(!ec) {
-              connection_open(connection, regex_endpoint.second);
-              read_message(connection, regex_endpoint.second);
-            }
-            else
-              connection_error(connection, regex_endpoint.second, ec);
-          });
+      StatusCode status_code = StatusCode::information_switching_protocols;
+      auto key_it = connection->header.find("Sec-WebSocket-Key");
+      if(key_it == connection->header.end())
+        status_code = StatusCode::client_error_upgrade_required;
+      else {
+        CaseInsensitiveMultimap response_header = config.header;
+        response_header.emplace("Upgrade", "websocket");
+        response_header.emplace("Connection", "Upgrade");
+        response_header.emplace("Sec-WebSocket-Accept", Crypto::websocket_accept(key_it->second));
+
+        try {
+          connection->endpoint = connection->socket->lowest_layer().remote_endpoint();
+        }
+        catch(...) {
+        }
+
+        if(route_endpoint.on_handshake)
+          status_code = route_endpoint.on_handshake(connection, response_header);
+
+        if(status_code == StatusCode::information_switching_protocols) {
+          ostream << "HTTP/1.1 101 Web Socket Protocol Handshake\r\n";
+          for(auto &header_field : response_header)
+            ostream << header_field.first << ": " << header_field.second << "\r\n";
+          ostream << "\r\n";
+        }
+      }
+      if(status_code != StatusCode::information_switching_protocols)
+        ostream << "HTTP/1.1 " + SimpleWeb::status_code(status_code) + "\r\n\r\n";
+
+      connection->path_match = std::move(path_match);
+      connection->set_timeout(config.timeout_request);
+      connection->async_write(*streambuf, [this, connection, streambuf, &route_endpoint, status_code](const error_code &ec, std::size_t /*bytes_transferred*/) {
+        connection->cancel_timeout();
+        auto lock = connection->handler_runner->continue_lock();
+        if(!lock)
+          return;
+        if(status_code != StatusCode::information_switching_protocols)
           return;
+
+        if(!ec) {
+          connection_open(connection, route_endpoint);
+          read_message(connection, route_endpoint);
         }
+        else
+          connection_error(connection, route_endpoint, ec);
+      });
+    }
+
+    /// Answers a request to config.metrics_path, the connection is closed afterwards
+    void write_metrics(const std::shared_ptr<Connection> &connection) {
+      auto body = counters->snapshot().prometheus();
+      auto streambuf = std::make_shared<asio::streambuf>();
+      std::ostream ostream(streambuf.get());
+      if(connection->method == "GET") {
+        ostream << "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n"
+                << body;
       }
+      else
+        ostream << "HTTP/1.1 " << SimpleWeb::status_code(StatusCode::client_error_method_not_allowed) << "\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+      connection->set_timeout(config.timeout_request);
+      connection->async_write(*streambuf, [connection, streambuf](const error_code & /*ec*/, std::size_t /*bytes_transferred*/) {
+        connection->cancel_timeout();
+        auto lock = connection->handler_runner->continue_lock();
+        if(!lock)
+          return;
+        connection->close();
+      });
     }
 
     void read_message(const std::shared_ptr<Connection> &connection, Endpoint &endpoint) const {
@@ -689,6 +910,7 @@ namespace SimpleWeb {
 
     void read_message_content(const std::shared_ptr<Connection> &connection, std::size_t length, Endpoint &endpoint, unsigned char fin_rsv_opcode) const {
       if(length + (connection->fragmented_in_message ? connection->fragmented_in_message->length : 0) > config.max_message_size) {
+        connection->counters.message_oversized();
         connection_error(connection, endpoint, make_error_code::make_error_code(errc::message_size));
         const int status = 1009;
         const std::string reason = "message too big";
@@ -711,6 +933,8 @@ namespace SimpleWeb {
 
           std::shared_ptr<InMessage> in_message;
 
+          connection->counters.frame_received(TransportCounters::header_size(length, true) + length, (fin_rsv_opcode & 0x80) == 0 || (fin_rsv_opcode & 0x0f) == 0);
+
           // If fragmented message
           if((fin_rsv_opcode & 0x80) == 0 || (fin_rsv_opcode & 0x0f) == 0) {
             if(!connection->fragmented_in_message) {
@@ -767,6 +991,7 @@ namespace SimpleWeb {
             this->read_message(connection, endpoint);
           }
           else {
+            connection->counters.message_received();
             if(endpoint.on_message)
               endpoint.on_message(connection, in_message);
 
@@ -786,6 +1011,7 @@ namespace SimpleWeb {
         LockGuard lock(endpoint.connections_mutex);
         endpoint.connections.insert(connection);
       }
+      connection->counters.connection_opened();
 
       if(endpoint.on_open)
         endpoint.on_open(connection);
@@ -796,6 +1022,7 @@ namespace SimpleWeb {
         LockGuard lock(endpoint.connections_mutex);
         endpoint.connections.erase(connection);
       }
+      connection->counters.connection_closed();
 
       if(endpoint.on_close)
         endpoint.on_close(connection, status, reason);
@@ -806,6 +1033,7 @@ namespace SimpleWeb {
         LockGuard lock(endpoint.connections_mutex);
         endpoint.connections.erase(connection);
       }
+      connection->counters.connection_closed();
 
       if(endpoint.on_error)
         endpoint.on_error(connection, ec);
@@ -823,16 +1051,16 @@ namespace SimpleWeb {
     SocketServer() noexcept : SocketServerBase<WS>(80) {}
 
   protected:
-    void accept() override {
-      std::shared_ptr<Connection> connection(new Connection(handler_runner, config.timeout_idle, *io_service));
+    void accept(io_context &acceptor_io_service, asio::ip::tcp::acceptor &shard_acceptor) override {
+      std::shared_ptr<Connection> connection(new Connection(handler_runner, config.timeout_idle, acceptor_io_service));
 
-      acceptor->async_accept(*connection->socket, [this, connection](const error_code &ec) {
+      shard_acceptor.async_accept(*connection->socket, [this, connection, &acceptor_io_service, &shard_acceptor](const error_code &ec) {
         auto lock = connection->handler_runner->continue_lock();
         if(!lock)
           return;
         // Immediately start accepting a new connection (if io_service hasn't been stopped)
         if(ec != error::operation_aborted)
-          accept();
+          accept(acceptor_io_service, shard_acceptor);
 
         if(!ec) {
           asio::ip::tcp::no_delay option(true);
@@ -1,6 +1,7 @@
 #ifndef SIMPLE_WEB_SERVER_WSS_HPP
 #define SIMPLE_WEB_SERVER_WSS_HPP
 
+#include "ktls.hpp"
 #include "server_ws.hpp"
 #include <algorithm>
 #include <openssl/ssl.h>
@@ -53,6 +54,9 @@ namespace SimpleWeb {
     asio::ssl::context context;
 
     void after_bind() override {
+      if(config.kernel_tls)
+        KernelTLS::prepare(context, true);
+
       if(set_session_id_context) {
         // Creating session_id_context from address:port but reversed due to small SSL_MAX_SSL_SESSION_ID_LENGTH
         auto session_id_context = std::to_string(acceptor->local_endpoint().port()) + ':';
@@ -62,16 +66,16 @@ namespace SimpleWeb {
       }
     }
 
-    void accept() override {
-      std::shared_ptr<Connection> connection(new Connection(handler_runner, config.timeout_idle, *io_service, context));
+    void accept(io_context &acceptor_io_service, asio::ip::tcp::acceptor &shard_acceptor) override {
+      std::shared_ptr<Connection> connection(new Connection(handler_runner, config.timeout_idle, acceptor_io_service, context));
 
-      acceptor->async_accept(connection->socket->lowest_layer(), [this, connection](const error_code &ec) {
+      shard_acceptor.async_accept(connection->socket->lowest_layer(), [this, connection, &acceptor_io_service, &shard_acceptor](const error_code &ec) {
         auto lock = connection->handler_runner->continue_lock();
         if(!lock)
           return;
         // Immediately start accepting a new connection (if io_service hasn't been stopped)
         if(ec != error::operation_aborted)
-          accept();
+          accept(acceptor_io_service, shard_acceptor);
 
         if(!ec) {
           asio::ip::tcp::no_delay option(true);
@@ -83,8 +87,11 @@ namespace SimpleWeb {
             auto lock = connection->handler_runner->continue_lock();
             if(!lock)
               return;
-            if(!ec)
+            if(!ec) {
+              if(config.kernel_tls)
+                connection->kernel_tls = KernelTLS::enable_send(connection->socket->native_handle(), connection->socket->lowest_layer().native_handle());
               read_handshake(connection);
+            }
           });
         }
       });
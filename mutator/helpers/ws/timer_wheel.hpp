@@ -0,0 +1,199 @@
+#ifndef SIMPLE_WEB_TIMER_WHEEL_HPP
+#define SIMPLE_WEB_TIMER_WHEEL_HPP
+
+#include "asio_compatibility.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SimpleWeb {
+  /// Coarse connection timeouts shared by all connections of an io_context, one wheel per context.
+  /// Rearming or cancelling an entry is an atomic store in the common case where the new deadline
+  /// is not earlier than the slot the entry already waits in; entries are moved to their real slot lazily
+  /// when that slot is reached. Deadlines are rounded up to the resolution, so a timeout never fires early.
+  class TimerWheel : public io_context::service {
+  public:
+    static constexpr std::chrono::milliseconds resolution{250};
+
+    class Entry {
+      friend class TimerWheel;
+
+    public:
+      explicit Entry(std::function<void()> on_expire_) noexcept : on_expire(std::move(on_expire_)) {}
+
+    private:
+      static constexpr std::uint64_t unscheduled = (std::numeric_limits<std::uint64_t>::max)();
+
+      /// Tick at which the entry expires, 0 if disarmed
+      std::atomic<std::uint64_t> deadline{0};
+      /// Tick at which the wheel looks at the entry next, unscheduled if it's in no slot
+      std::atomic<std::uint64_t> scheduled{unscheduled};
+      std::function<void()> on_expire;
+    };
+
+    inline static io_context::id id;
+
+    explicit TimerWheel(io_context &context) : io_context::service(context), timer(context), epoch(std::chrono::steady_clock::now()) {}
+
+    /// The wheel of the context a socket runs on
+    template <typename socket_type>
+    static TimerWheel &get(socket_type &socket) {
+      return asio::use_service<TimerWheel>(SimpleWeb::get_io_context(socket));
+    }
+
+    /// Arms the entry to expire in the given number of seconds, 0 disarms it
+    void set(const std::shared_ptr<Entry> &entry, long seconds) {
+      if(seconds <= 0) {
+        entry->deadline = 0;
+        return;
+      }
+
+      auto deadline = current_tick() + static_cast<std::uint64_t>((std::chrono::seconds(seconds) + resolution - std::chrono::milliseconds(1)) / resolution) + 1;
+      entry->deadline = deadline;
+
+      // The entry is looked at in time and reads the new deadline then
+      if(entry->scheduled <= deadline)
+        return;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if(entry->scheduled > deadline)
+        place(entry, deadline);
+    }
+
+    void cancel(Entry &entry) noexcept {
+      entry.deadline = 0;
+    }
+
+  private:
+    static constexpr std::size_t inner_slots = 256;
+    static constexpr std::size_t outer_slots = 64;
+
+    asio::steady_timer timer;
+    std::chrono::steady_clock::time_point epoch;
+
+    std::mutex mutex;
+    std::array<std::vector<std::shared_ptr<Entry>>, inner_slots> inner;
+    /// Every outer slot covers inner_slots ticks, entries further out than the outer span wait there for several rounds
+    std::array<std::vector<std::shared_ptr<Entry>>, outer_slots> outer;
+    std::size_t queued = 0;
+    std::uint64_t processed_tick = 0;
+    bool ticking = false;
+
+    void shutdown() override {
+      std::lock_guard<std::mutex> lock(mutex);
+      error_code ec;
+      timer.cancel(ec);
+      for(auto &slot : inner)
+        slot.clear();
+      for(auto &slot : outer)
+        slot.clear();
+      queued = 0;
+    }
+
+    std::uint64_t current_tick() const noexcept {
+      return static_cast<std::uint64_t>((std::chrono::steady_clock::now() - epoch) / resolution);
+    }
+
+    /// mutex must be locked here
+    void place(const std::shared_ptr<Entry> &entry, std::uint64_t deadline) {
+      if(queued == 0 && !ticking)
+        processed_tick = current_tick();
+
+      auto tick = (std::max)(deadline, processed_tick + 1);
+      if(tick - processed_tick < inner_slots) {
+        inner[tick % inner_slots].emplace_back(entry);
+        entry->scheduled = tick;
+      }
+      else {
+        // Moved to the inner wheel when the inner wheel wraps around to this outer slot,
+        // which may happen several rounds before the deadline
+        auto slot = (tick / inner_slots) % outer_slots;
+        auto next_round = processed_tick / inner_slots + 1;
+        auto visit_round = next_round + (slot + outer_slots - next_round % outer_slots) % outer_slots;
+        outer[slot].emplace_back(entry);
+        entry->scheduled = visit_round * inner_slots;
+      }
+      ++queued;
+
+      if(!ticking) {
+        ticking = true;
+        schedule_tick();
+      }
+    }
+
+    void schedule_tick() {
+      timer.expires_at(epoch + resolution * (processed_tick + 1));
+      timer.async_wait([this](const error_code &ec) {
+        if(!ec)
+          tick();
+      });
+    }
+
+    void tick() {
+      std::vector<std::shared_ptr<Entry>> expired;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = current_tick();
+        while(processed_tick < now && queued > 0) {
+          ++processed_tick;
+
+          if(processed_tick % inner_slots == 0) {
+            auto cascade = std::move(outer[(processed_tick / inner_slots) % outer_slots]);
+            outer[(processed_tick / inner_slots) % outer_slots].clear();
+            queued -= cascade.size();
+            for(auto &entry : cascade)
+              visit(entry, expired);
+          }
+
+          auto slot = std::move(inner[processed_tick % inner_slots]);
+          inner[processed_tick % inner_slots].clear();
+          queued -= slot.size();
+          for(auto &entry : slot)
+            visit(entry, expired);
+        }
+
+        if(queued > 0)
+          schedule_tick();
+        else
+          ticking = false;
+      }
+
+      for(auto &entry : expired) {
+        if(entry->on_expire)
+          entry->on_expire();
+      }
+    }
+
+    /// mutex must be locked here
+    void visit(const std::shared_ptr<Entry> &entry, std::vector<std::shared_ptr<Entry>> &expired) {
+      // A copy left behind by an earlier rearm, the entry is looked at elsewhere
+      auto scheduled = processed_tick;
+      if(!entry->scheduled.compare_exchange_strong(scheduled, Entry::unscheduled))
+        return;
+
+      while(true) {
+        auto deadline = entry->deadline.load();
+        if(deadline == 0)
+          return;
+        if(deadline > processed_tick) {
+          place(entry, deadline);
+          return;
+        }
+        // Fails if the entry was rearmed meanwhile
+        if(entry->deadline.compare_exchange_strong(deadline, 0)) {
+          expired.emplace_back(entry);
+          return;
+        }
+      }
+    }
+  };
+} // namespace SimpleWeb
+
+#endif /* SIMPLE_WEB_TIMER_WHEEL_HPP */
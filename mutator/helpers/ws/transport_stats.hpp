@@ -0,0 +1,185 @@
+#ifndef SIMPLE_WEB_TRANSPORT_STATS_HPP
+#define SIMPLE_WEB_TRANSPORT_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace SimpleWeb {
+  /// Transport counters at one point in time. Frame sizes include the frame header.
+  struct TransportStats {
+    std::uint64_t connections_opened = 0;
+    std::uint64_t connections_closed = 0;
+    std::uint64_t bytes_sent = 0;
+    std::uint64_t bytes_received = 0;
+    std::uint64_t frames_sent = 0;
+    std::uint64_t frames_received = 0;
+    /// Frames that are part of a fragmented message, the final fragment included
+    std::uint64_t fragments_received = 0;
+    /// Complete data messages handed to on_message
+    std::uint64_t messages_received = 0;
+    /// Incoming messages rejected for exceeding Config::max_message_size
+    std::uint64_t oversized_messages = 0;
+    std::uint64_t largest_frame_sent = 0;
+    std::uint64_t largest_frame_received = 0;
+    /// Messages waiting in send queues, the one being written included
+    std::uint64_t send_queue_depth = 0;
+    std::uint64_t send_queue_depth_max = 0;
+    /// Time messages waited in send queues before their write started, summed over all sent frames
+    std::chrono::nanoseconds send_queue_time{0};
+
+    /// The counters in the Prometheus text exposition format, every metric name starts with prefix
+    std::string prometheus(const std::string &prefix = "websocket_") const {
+      std::ostringstream stream;
+      auto metric = [&stream, &prefix](const char *name, const char *type, const char *help, const std::string &value) {
+        stream << "# HELP " << prefix << name << ' ' << help << "\n";
+        stream << "# TYPE " << prefix << name << ' ' << type << "\n";
+        stream << prefix << name << ' ' << value << "\n";
+      };
+      metric("connections_opened_total", "counter", "Connections that completed the websocket handshake.", std::to_string(connections_opened));
+      metric("connections_open", "gauge", "Connections currently open.", std::to_string(connections_opened - connections_closed));
+      metric("sent_bytes_total", "counter", "Bytes of websocket frames sent.", std::to_string(bytes_sent));
+      metric("received_bytes_total", "counter", "Bytes of websocket frames received.", std::to_string(bytes_received));
+      metric("sent_frames_total", "counter", "Websocket frames sent.", std::to_string(frames_sent));
+      metric("received_frames_total", "counter", "Websocket frames received.", std::to_string(frames_received));
+      metric("received_fragments_total", "counter", "Received frames that are part of a fragmented message.", std::to_string(fragments_received));
+      metric("received_messages_total", "counter", "Complete data messages received.", std::to_string(messages_received));
+      metric("oversized_messages_total", "counter", "Received messages rejected for exceeding the maximum message size.", std::to_string(oversized_messages));
+      metric("sent_frame_bytes_max", "gauge", "Largest websocket frame sent.", std::to_string(largest_frame_sent));
+      metric("received_frame_bytes_max", "gauge", "Largest websocket frame received.", std::to_string(largest_frame_received));
+      metric("send_queue_depth", "gauge", "Messages waiting to be sent.", std::to_string(send_queue_depth));
+      metric("send_queue_depth_max", "gauge", "Highest number of messages waiting to be sent.", std::to_string(send_queue_depth_max));
+      std::ostringstream seconds;
+      seconds.precision(9);
+      seconds << std::chrono::duration<double>(send_queue_time).count();
+      metric("send_queue_seconds_total", "counter", "Time messages waited in the send queue.", seconds.str());
+      return stream.str();
+    }
+  };
+
+  /// Counters of one connection, or of all connections of a server or client. Updated with relaxed atomics,
+  /// so counters read together may be from slightly different points in time.
+  /// Connection counters add everything to their parent as well, which keeps the totals of the server or client.
+  class TransportCounters {
+  public:
+    /// Set before the connection sends or receives frames
+    std::shared_ptr<TransportCounters> parent;
+
+    /// Size of a frame header with the given payload length
+    static std::size_t header_size(std::size_t length, bool masked) noexcept {
+      return 2 + (length >= 126 ? (length > 0xffff ? std::size_t(8) : std::size_t(2)) : std::size_t(0)) + (masked ? std::size_t(4) : std::size_t(0));
+    }
+
+    void connection_opened() noexcept {
+      if(!open.exchange(true, std::memory_order_relaxed)) {
+        add(connections_opened, 1);
+        if(parent)
+          parent->add(parent->connections_opened, 1);
+      }
+    }
+
+    /// Only the first call after connection_opened() counts, close and error handlers may both end up here
+    void connection_closed() noexcept {
+      if(open.exchange(false, std::memory_order_relaxed)) {
+        add(connections_closed, 1);
+        if(parent)
+          parent->add(parent->connections_closed, 1);
+      }
+    }
+
+    void message_queued() noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get())
+        counters->raise(counters->send_queue_depth_max, counters->send_queue_depth.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void messages_dequeued(std::size_t count) noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get())
+        counters->send_queue_depth.fetch_sub(count, std::memory_order_relaxed);
+    }
+
+    void write_started(std::chrono::steady_clock::time_point queued_at) noexcept {
+      auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - queued_at).count();
+      for(auto counters = this; counters; counters = counters->parent.get())
+        counters->add(counters->send_queue_ns, static_cast<std::uint64_t>(waited));
+    }
+
+    void frame_sent(std::size_t frame_size) noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get()) {
+        counters->add(counters->frames_sent, 1);
+        counters->add(counters->bytes_sent, frame_size);
+        counters->raise(counters->largest_frame_sent, frame_size);
+      }
+    }
+
+    void frame_received(std::size_t frame_size, bool fragment) noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get()) {
+        counters->add(counters->frames_received, 1);
+        counters->add(counters->bytes_received, frame_size);
+        if(fragment)
+          counters->add(counters->fragments_received, 1);
+        counters->raise(counters->largest_frame_received, frame_size);
+      }
+    }
+
+    void message_received() noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get())
+        counters->add(counters->messages_received, 1);
+    }
+
+    void message_oversized() noexcept {
+      for(auto counters = this; counters; counters = counters->parent.get())
+        counters->add(counters->oversized_messages, 1);
+    }
+
+    TransportStats snapshot() const noexcept {
+      TransportStats stats;
+      stats.connections_opened = connections_opened.load(std::memory_order_relaxed);
+      stats.connections_closed = connections_closed.load(std::memory_order_relaxed);
+      stats.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+      stats.bytes_received = bytes_received.load(std::memory_order_relaxed);
+      stats.frames_sent = frames_sent.load(std::memory_order_relaxed);
+      stats.frames_received = frames_received.load(std::memory_order_relaxed);
+      stats.fragments_received = fragments_received.load(std::memory_order_relaxed);
+      stats.messages_received = messages_received.load(std::memory_order_relaxed);
+      stats.oversized_messages = oversized_messages.load(std::memory_order_relaxed);
+      stats.largest_frame_sent = largest_frame_sent.load(std::memory_order_relaxed);
+      stats.largest_frame_received = largest_frame_received.load(std::memory_order_relaxed);
+      stats.send_queue_depth = send_queue_depth.load(std::memory_order_relaxed);
+      stats.send_queue_depth_max = send_queue_depth_max.load(std::memory_order_relaxed);
+      stats.send_queue_time = std::chrono::nanoseconds(send_queue_ns.load(std::memory_order_relaxed));
+      return stats;
+    }
+
+  private:
+    std::atomic<bool> open{false};
+    std::atomic<std::uint64_t> connections_opened{0};
+    std::atomic<std::uint64_t> connections_closed{0};
+    std::atomic<std::uint64_t> bytes_sent{0};
+    std::atomic<std::uint64_t> bytes_received{0};
+    std::atomic<std::uint64_t> frames_sent{0};
+    std::atomic<std::uint64_t> frames_received{0};
+    std::atomic<std::uint64_t> fragments_received{0};
+    std::atomic<std::uint64_t> messages_received{0};
+    std::atomic<std::uint64_t> oversized_messages{0};
+    std::atomic<std::uint64_t> largest_frame_sent{0};
+    std::atomic<std::uint64_t> largest_frame_received{0};
+    std::atomic<std::uint64_t> send_queue_depth{0};
+    std::atomic<std::uint64_t> send_queue_depth_max{0};
+    std::atomic<std::uint64_t> send_queue_ns{0};
+
+    static void add(std::atomic<std::uint64_t> &counter, std::uint64_t value) noexcept {
+      counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void raise(std::atomic<std::uint64_t> &counter, std::uint64_t value) noexcept {
+      auto current = counter.load(std::memory_order_relaxed);
+      while(value > current && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+      }
+    }
+  };
+} // namespace SimpleWeb
+
+#endif /* SIMPLE_WEB_TRANSPORT_STATS_HPP */
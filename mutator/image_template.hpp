@@ -0,0 +1,216 @@
+#ifndef PZM_IMAGE_TEMPLATE_HPP
+#define PZM_IMAGE_TEMPLATE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "helpers/json.hpp"
+
+#include "import_table.hpp"
+
+namespace pzm {
+
+    // every location inside of a region that holds an absolute address pointing into the target region
+    // the template image is mapped with all region bases set to zero, so rebasing is a plain addition
+    struct relocation_block_t {
+        uint32_t region = 0;
+        uint32_t target = 0;
+        uint32_t width = 8;
+        std::vector< uint32_t > offsets;
+    };
+
+    // location of an imported function address inside of a region
+    struct import_slot_t {
+        std::string module;
+        std::string function;
+        uint32_t region = 0;
+        uint32_t offset = 0;
+        uint32_t width = 8;
+
+        // position of the function in its module's array of mapper_data[ "imports" ], used to look it up in an import_table_t
+        uint32_t index = 0;
+    };
+
+    // mutated image received once from the server together with its relocation list and import slot table
+    // apply produces the mapped binaries for any client layout locally, without a proceed round trip
+    class c_image_template {
+
+        public:
+
+            bool parse( const nlohmann::json& response ) {
+                try {
+                    mapper_data = response.at( "data" );
+                    regions = response.at( "pe_bin" ).get< std::vector< std::vector< uint8_t > > >( );
+
+                    relocations.clear( );
+                    for ( const auto& entry : response.at( "relocations" ) ) {
+                        relocation_block_t block;
+                        block.region = entry.at( "region" ).get< uint32_t >( );
+                        block.target = entry.at( "target" ).get< uint32_t >( );
+                        block.width = entry.at( "size" ).get< uint32_t >( );
+                        block.offsets = entry.at( "offsets" ).get< std::vector< uint32_t > >( );
+
+                        // sorted offsets keep the patch loop walking memory forward
+                        std::sort( block.offsets.begin( ), block.offsets.end( ) );
+
+                        if ( !is_valid( block.region, block.width, block.offsets ) || block.target >= regions.size( ) )
+                            return false;
+
+                        relocations.push_back( std::move( block ) );
+                    }
+
+                    // positions of the functions within their module's array, the way import_table_t::find takes them
+                    std::map< std::pair< std::string, std::string >, uint32_t > import_indices;
+                    if ( mapper_data.contains( "imports" ) ) {
+                        for ( const auto& imported_module : mapper_data.at( "imports" ).items( ) ) {
+                            uint32_t position = 0;
+                            for ( const auto& function : imported_module.value( ) )
+                                import_indices.emplace( std::make_pair( imported_module.key( ), function.get< std::string >( ) ), position++ );
+                        }
+                    }
+
+                    imports.clear( );
+                    for ( const auto& entry : response.at( "imports" ) ) {
+                        import_slot_t slot;
+                        slot.module = entry.at( "module" ).get< std::string >( );
+                        slot.function = entry.at( "function" ).get< std::string >( );
+                        slot.region = entry.at( "region" ).get< uint32_t >( );
+                        slot.offset = entry.at( "offset" ).get< uint32_t >( );
+                        slot.width = entry.value( "size", 8u );
+
+                        if ( !is_valid( slot.region, slot.width, { slot.offset } ) )
+                            return false;
+
+                        // a slot the import table has no entry for would silently get another import's address
+                        auto index = import_indices.find( std::make_pair( slot.module, slot.function ) );
+                        if ( index == import_indices.end( ) )
+                            return false;
+
+                        slot.index = index->second;
+
+                        imports.push_back( std::move( slot ) );
+                    }
+                } catch ( ... ) {
+                    return false;
+                }
+
+                return true;
+            }
+
+            // client_info carries "bases" and either "imports" or "import_table" in the same layout as for proceed
+            bool apply( const nlohmann::json& client_info, std::vector< std::vector< uint8_t > >& binaries ) const {
+                std::vector< uint64_t > bases;
+                std::vector< uint64_t > addresses;
+
+                try {
+                    bases = client_info.at( "bases" ).get< std::vector< uint64_t > >( );
+
+                    addresses.reserve( imports.size( ) );
+                    if ( client_info.contains( "import_table" ) ) {
+                        import_table_t import_table;
+                        if ( !import_table.parse( client_info.at( "import_table" ) ) )
+                            return false;
+
+                        for ( const auto& slot : imports ) {
+                            if ( !import_table.find( slot.module, slot.index, addresses.emplace_back( ) ) )
+                                return false;
+                        }
+                    } else {
+                        const auto& client_imports = client_info.at( "imports" );
+                        for ( const auto& slot : imports )
+                            addresses.push_back( client_imports.at( slot.module ).at( slot.function ).get< uint64_t >( ) );
+                    }
+                } catch ( ... ) {
+                    return false;
+                }
+
+                return apply( bases, addresses, binaries );
+            }
+
+            // addresses are ordered the same way as import_slots( )
+            bool apply( const std::vector< uint64_t >& bases, const std::vector< uint64_t >& addresses,
+                std::vector< std::vector< uint8_t > >& binaries ) const {
+                if ( bases.size( ) < regions.size( ) || addresses.size( ) < imports.size( ) )
+                    return false;
+
+                binaries.resize( regions.size( ) );
+                for ( size_t region = 0; region < regions.size( ); ++region ) {
+                    binaries[ region ].resize( regions[ region ].size( ) );
+                    if ( !regions[ region ].empty( ) )
+                        memcpy( binaries[ region ].data( ), regions[ region ].data( ), regions[ region ].size( ) );
+                }
+
+                // offsets were validated in parse, so the patch loops don't need any bound checks
+                for ( const auto& block : relocations ) {
+                    auto image = binaries[ block.region ].data( );
+                    if ( block.width == sizeof( uint64_t ) )
+                        relocate< uint64_t >( image, block.offsets.data( ), block.offsets.size( ), bases[ block.target ] );
+                    else
+                        relocate< uint32_t >( image, block.offsets.data( ), block.offsets.size( ), bases[ block.target ] );
+                }
+
+                for ( size_t index = 0; index < imports.size( ); ++index ) {
+                    const auto& slot = imports[ index ];
+                    auto image = binaries[ slot.region ].data( ) + slot.offset;
+                    if ( slot.width == sizeof( uint64_t ) ) {
+                        memcpy( image, &addresses[ index ], sizeof( uint64_t ) );
+                    } else {
+                        auto address = static_cast< uint32_t >( addresses[ index ] );
+                        memcpy( image, &address, sizeof( uint32_t ) );
+                    }
+                }
+
+                return true;
+            }
+
+            const nlohmann::json& get_mapper_data( ) const {
+                return mapper_data;
+            }
+
+            const std::vector< import_slot_t >& import_slots( ) const {
+                return imports;
+            }
+
+            // for data the server never saw, restored by the client before the template is applied ( see restitch )
+            std::vector< std::vector< uint8_t > >& template_regions( ) {
+                return regions;
+            }
+
+        private:
+
+            // relocations are independent of each other, which lets the compiler keep this loop tight
+            template< class T >
+            static void relocate( uint8_t* image, const uint32_t* offsets, size_t count, uint64_t base ) {
+                auto delta = static_cast< T >( base );
+                for ( size_t index = 0; index < count; ++index ) {
+                    T value;
+                    memcpy( &value, image + offsets[ index ], sizeof( T ) );
+                    value += delta;
+                    memcpy( image + offsets[ index ], &value, sizeof( T ) );
+                }
+            }
+
+            bool is_valid( uint32_t region, uint32_t width, const std::vector< uint32_t >& offsets ) const {
+                if ( region >= regions.size( ) || ( width != sizeof( uint32_t ) && width != sizeof( uint64_t ) ) )
+                    return false;
+
+                auto region_size = regions[ region ].size( );
+                return std::all_of( offsets.begin( ), offsets.end( ), [ & ] ( uint32_t offset ) {
+                    return region_size >= width && offset <= region_size - width;
+                } );
+            }
+
+            nlohmann::json mapper_data;
+            std::vector< std::vector< uint8_t > > regions;
+            std::vector< relocation_block_t > relocations;
+            std::vector< import_slot_t > imports;
+
+    };
+
+}
+
+#endif /* PZM_IMAGE_TEMPLATE_HPP */
@@ -0,0 +1,87 @@
+#ifndef PZM_IMPORT_TABLE_HPP
+#define PZM_IMPORT_TABLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "helpers/ws/crypto.hpp"
+#include "helpers/json.hpp"
+
+namespace pzm {
+
+    // indexed replacement for client_info[ "imports" ][ module ][ function ] = address
+    // addresses are packed module by module, modules[ i ] contributing counts[ i ] of them
+    // the functions of a module are in the order of its array in mapper_data[ "imports" ][ module ],
+    // modules are named because the order of the keys of mapper_data[ "imports" ] isn't kept by every json library,
+    // so a server has to look modules up by name and functions by their position in the module's array
+    struct import_table_t {
+        std::vector< std::string > modules;
+        std::vector< uint32_t > counts;
+        std::vector< uint64_t > addresses;
+
+        // address of the function at position in the module's array of mapper_data[ "imports" ]
+        bool find( const std::string& module, size_t position, uint64_t& address ) const {
+            size_t offset = 0;
+            for ( size_t index = 0; index < modules.size( ); ++index ) {
+                if ( modules[ index ] == module ) {
+                    if ( position >= counts[ index ] )
+                        return false;
+
+                    address = addresses[ offset + position ];
+                    return true;
+                }
+
+                offset += counts[ index ];
+            }
+
+            return false;
+        }
+
+        // addresses are sent as little-endian uint64_t values, base64 encoded
+        nlohmann::json to_json( ) const {
+            std::string packed( addresses.size( ) * sizeof( uint64_t ), '\0' );
+            for ( size_t index = 0; index < addresses.size( ); ++index ) {
+                for ( size_t byte = 0; byte < sizeof( uint64_t ); ++byte )
+                    packed[ index * sizeof( uint64_t ) + byte ] = static_cast< char >( addresses[ index ] >> ( 8 * byte ) );
+            }
+
+            nlohmann::json table;
+            table[ "modules" ] = modules;
+            table[ "counts" ] = counts;
+            table[ "addresses" ] = SimpleWeb::Crypto::Base64::encode( packed );
+            return table;
+        }
+
+        bool parse( const nlohmann::json& table ) {
+            try {
+                modules = table.at( "modules" ).get< std::vector< std::string > >( );
+                counts = table.at( "counts" ).get< std::vector< uint32_t > >( );
+
+                auto packed = SimpleWeb::Crypto::Base64::decode( table.at( "addresses" ).get< std::string >( ) );
+                addresses.resize( packed.size( ) / sizeof( uint64_t ) );
+                for ( size_t index = 0; index < addresses.size( ); ++index ) {
+                    uint64_t address = 0;
+                    for ( size_t byte = 0; byte < sizeof( uint64_t ); ++byte )
+                        address |= static_cast< uint64_t >( static_cast< uint8_t >( packed[ index * sizeof( uint64_t ) + byte ] ) ) << ( 8 * byte );
+
+                    addresses[ index ] = address;
+                }
+            } catch ( ... ) {
+                return false;
+            }
+
+            if ( modules.size( ) != counts.size( ) )
+                return false;
+
+            size_t total = 0;
+            for ( auto count : counts )
+                total += count;
+
+            return total == addresses.size( );
+        }
+    };
+
+}
+
+#endif /* PZM_IMPORT_TABLE_HPP */
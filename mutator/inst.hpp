@@ -1,35 +1,562 @@
+#ifndef PZM_INST_HPP
+#define PZM_INST_HPP
+
 #include <iostream>
 #include <unordered_map>
+#include <map>
 #include <functional>
+#include <algorithm>
 #include <deque>
 #include <fstream>
 #include <filesystem>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <span>
+#include <limits>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <random>
 
 #include "helpers/ws/server_wss.hpp"
 #include "helpers/ws/client_wss.hpp"
 
 #include "helpers/json.hpp"
 
+#include "image_template.hpp"
+#include "import_table.hpp"
+#include "result_cache.hpp"
+#include "mapped_file.hpp"
+#include "pe_image.hpp"
+#include "map_index.hpp"
+#include "pe_trim.hpp"
+#include "phase_stats.hpp"
+
 namespace pzm {
-    using ws_client_t = SimpleWeb::SocketClient< SimpleWeb::WSS >;
+    using ws_client_t = SimpleWeb::SocketClient< SimpleWeb::WS >;
+    using wss_client_t = SimpleWeb::SocketClient< SimpleWeb::WSS >;
 
     struct ws_packet_t {
         size_t packet_id = 0;
         nlohmann::json content;
     };
 
-    int request_status = -1;
-
     std::string username;
     std::string password;
-    std::string session_id;
 
-    nlohmann::json pending_request;
+    constexpr auto default_endpoint = "pzm322.com/ws/mutator";
+
+    // how a connection reaches the mutator, the defaults match the public service
+    struct transport_config_t {
+        // host[:port][/path]
+        std::string endpoint = default_endpoint;
+
+        // plain ws is meant for a local sidecar or a tls-terminating proxy in front of the mutator
+        bool secure = true;
+        bool verify_certificate = false;
+        // ca bundle used for verification instead of the system default paths
+        std::string verify_file;
+        // let the kernel encrypt outgoing records ( linux, tls 1.3 with aes-gcm ), openssl is used where it can't
+        bool kernel_tls = false;
+        // tls session kept on disk, later runs resume it and skip the full handshake
+        std::string session_cache_file;
+        // sends the client hello with the syn once the server handed out a cookie ( linux )
+        bool fast_open = false;
+
+        // in seconds, 0 disables the timeout
+        long timeout_request = 0;
+        long timeout_idle = 0;
+        size_t max_message_size = ( std::numeric_limits< size_t >::max )( );
+
+        // additional fields of the upgrade request
+        SimpleWeb::CaseInsensitiveMultimap header;
+        // server:port and username:password
+        std::string proxy_server;
+        std::string proxy_auth;
+
+        // runs the connection on an existing context, which the caller keeps running
+        std::shared_ptr< SimpleWeb::io_context > io_context;
+        // threads running the connection's own context, unused if io_context is set
+        size_t threads = 1;
+
+        // a dropped connection is reopened up to reconnect_attempts times in a row, 0 disables reconnecting
+        // the delay doubles with every attempt up to reconnect_max_delay, with some jitter
+        size_t reconnect_attempts = 8;
+        std::chrono::milliseconds reconnect_delay = std::chrono::milliseconds( 100 );
+        std::chrono::milliseconds reconnect_max_delay = std::chrono::seconds( 5 );
+        // longest wait for a response on an open connection, 0 waits as long as the connection lives
+        std::chrono::milliseconds wait_timeout = std::chrono::milliseconds( 0 );
+    };
+
+    class c_mutator;
+    class c_connection;
+
+    namespace ws_callbacks {
+
+        void on_message( c_connection& owner, const std::string& message );
+
+    }
+
+    // websocket connection to the mutator together with the server session bound to it
+    // every c_mutator works through one of these, so several sessions can run side by side
+    // a dropped connection is reopened with backoff and reattached to its server session by session_id ( type 9 ),
+    // waits of requests lost with the connection fail right away and c_mutator sends them again once it's back
+    class c_connection : public std::enable_shared_from_this< c_connection > {
+
+        public:
+
+            explicit c_connection( transport_config_t config = { } ) : m_config( std::move( config ) ),
+                m_track( g_stats.next_track( ) ) { }
+
+            ~c_connection( ) {
+                stop( );
+            }
+
+            // returns false if the client couldn't be created, e.g. the verify file can't be loaded
+            bool start( ) {
+                m_connect_start = stats_clock_t::now( );
+
+                try {
+                    if ( m_config.secure ) {
+                        m_wss_client = std::make_unique< wss_client_t >( m_config.endpoint, m_config.verify_certificate,
+                            std::string( ), std::string( ), m_config.verify_file );
+                        run( *m_wss_client );
+                    } else {
+                        m_ws_client = std::make_unique< ws_client_t >( m_config.endpoint );
+                        run( *m_ws_client );
+                    }
+                } catch ( ... ) {
+                    return false;
+                }
+
+                return true;
+            }
+
+            void stop( ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    m_closing = true;
+                }
+
+                m_condition.notify_all( );
+
+                if ( m_ws_client )
+                    m_ws_client->stop( );
+
+                if ( m_wss_client )
+                    m_wss_client->stop( );
+
+                // a shared context belongs to the caller and keeps running
+                if ( m_io_context && !m_config.io_context )
+                    m_io_context->stop( );
+
+                // the last reference may be dropped from a handler, the io thread running it can't join itself
+                // and finishes on its own, it holds a reference to the context
+                for ( auto& thread : m_threads ) {
+                    if ( !thread.joinable( ) )
+                        continue;
+
+                    if ( thread.get_id( ) == std::this_thread::get_id( ) )
+                        thread.detach( );
+                    else
+                        thread.join( );
+                }
+
+                m_threads.clear( );
+            }
+
+            void detach( ) {
+                for ( auto& thread : m_threads ) {
+                    if ( thread.joinable( ) )
+                        thread.detach( );
+                }
+            }
+
+            bool auth( const std::string& user, const std::string& pass ) {
+                {
+                    // kept for reattaching the session after a reconnect
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    m_user = user;
+                    m_pass = pass;
+                }
+
+                nlohmann::json auth_request;
+                auth_request[ "username" ] = user;
+                auth_request[ "password" ] = pass;
+                auth_request[ "type" ] = 0;
+
+                c_phase_timer timer( phase_t::PHASE_AUTH, m_track );
+                for ( size_t attempt = 0; wait_ready( ); ++attempt ) {
+                    auto generation = send( auth_request );
+                    auto status = wait_status( generation );
+                    if ( status != -1 )
+                        return status == 0;
+
+                    if ( !lost( generation ) || attempt >= m_config.reconnect_attempts )
+                        break;
+                }
+
+                return false;
+            }
+
+            // waits until the connection is open and bound to its server session,
+            // false once reconnecting gave up or the connection was closed
+            bool wait_ready( ) {
+                std::unique_lock< std::mutex > lock( m_mutex );
+                m_condition.wait( lock, [ this ] ( ) { return m_send != nullptr || m_closing || m_failed; } );
+                return m_send != nullptr && !m_closing;
+            }
+
+            // returns the generation of the connection the request went out on, 0 if there was none
+            // on_sent runs once the request has been written to the socket
+            // every request carries the id of the server session it belongs to
+            uint64_t send( nlohmann::json request, std::function< void ( ) > on_sent = nullptr ) {
+                send_t send_message;
+                uint64_t generation = 0;
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    send_message = m_send;
+                    if ( send_message )
+                        generation = m_generation;
+
+                    request[ "session" ] = m_session_id;
+                }
+
+                if ( send_message )
+                    send_message( request.dump( ), std::move( on_sent ) );
+
+                return generation;
+            }
+
+            // ends the session, the connection isn't reopened afterwards
+            void close( ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_closing = true;
+                if ( m_close )
+                    m_close( );
+
+                m_condition.notify_all( );
+            }
+
+            // true if the connection a request went out on is gone, so its response never arrives
+            bool lost( uint64_t generation ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                return generation == 0 || generation != m_generation;
+            }
+
+            // changes whenever the server session was replaced by a fresh one and the uploaded image is gone
+            uint64_t session_epoch( ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                return m_session_epoch;
+            }
+
+            const transport_config_t& config( ) const {
+                return m_config;
+            }
+
+            // trace row of the connection and the mutator using it
+            uint64_t track( ) const {
+                return m_track;
+            }
+
+            // responses to data requests (mapper data, mapping results) are queued by their type,
+            // so several requests may be in flight at once without overwriting each other
+            void push_packet( size_t packet_id, nlohmann::json content ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    m_packets.push_back( { packet_id, std::move( content ) } );
+                }
+
+                m_condition.notify_all( );
+            }
+
+            // returns null if the connection of generation was lost or the wait timed out
+            nlohmann::json wait_packet( size_t packet_id, uint64_t generation ) {
+                std::unique_lock< std::mutex > lock( m_mutex );
+
+                auto packet = m_packets.end( );
+                auto found = wait( lock, generation, [ & ] ( ) {
+                    packet = std::find_if( m_packets.begin( ), m_packets.end( ),
+                        [ packet_id ] ( const ws_packet_t& entry ) { return entry.packet_id == packet_id; } );
+                    return packet != m_packets.end( );
+                } );
+
+                if ( !found )
+                    return { };
+
+                auto content = std::move( packet->content );
+                m_packets.erase( packet );
+                return content;
+            }
+
+            void set_status( int status ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    m_status = status;
+                }
+
+                m_condition.notify_all( );
+            }
+
+            // returns -1 if the connection of generation was lost or the wait timed out
+            int wait_status( uint64_t generation ) {
+                std::unique_lock< std::mutex > lock( m_mutex );
+                if ( !wait( lock, generation, [ this ] ( ) { return m_status != -1; } ) )
+                    return -1;
+
+                return std::exchange( m_status, -1 );
+            }
+
+            void set_session( const std::string& id ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+
+                // every connection is greeted with a fresh session, which is dropped if the old one is reattached
+                if ( m_resume_id.empty( ) )
+                    m_session_id = id;
+            }
+
+            // answer to the resume request sent after a reconnect, requests may be sent again from here on
+            void set_resumed( const nlohmann::json& response ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    if ( !m_resume_send )
+                        return;
+
+                    // the server no longer had the session, the image has to be uploaded again
+                    if ( !response.value( "resumed", false ) )
+                        ++m_session_epoch;
+
+                    m_session_id = response.value( "session_id", m_session_id );
+                    m_resume_id.clear( );
+                    m_send = std::move( m_resume_send );
+                    m_reconnects = 0;
+                }
+
+                m_condition.notify_all( );
+            }
+
+            // the c_mutator callbacks are routed to, set and cleared by c_mutator itself
+            void set_owner( c_mutator* owner ) {
+                std::lock_guard< std::mutex > lock( m_owner_mutex );
+                m_owner = owner;
+            }
+
+            // returns once no callback of owner is running anymore, none is started afterwards
+            void release_owner( c_mutator* owner ) {
+                std::lock_guard< std::mutex > lock( m_owner_mutex );
+                if ( m_owner == owner )
+                    m_owner = nullptr;
+            }
+
+            // runs handler on the owner, which can't be destroyed meanwhile, false if there is none
+            template< class handler_t >
+            bool with_owner( handler_t handler ) {
+                std::lock_guard< std::mutex > lock( m_owner_mutex );
+                return m_owner && handler( *m_owner );
+            }
+
+        private:
+
+            // guards m_owner for as long as a callback runs, apart from m_mutex as callbacks send their replies
+            std::mutex m_owner_mutex;
+            c_mutator* m_owner = nullptr;
+
+            // mutex must be locked here
+            template< class predicate_t >
+            bool wait( std::unique_lock< std::mutex >& lock, uint64_t generation, predicate_t predicate ) {
+                auto done = [ & ] ( ) {
+                    return predicate( ) || generation != m_generation || m_closing || m_failed;
+                };
+
+                if ( m_config.wait_timeout.count( ) == 0 )
+                    m_condition.wait( lock, done );
+                else
+                    m_condition.wait_for( lock, m_config.wait_timeout, done );
+
+                return generation != 0 && generation == m_generation && predicate( );
+            }
+
+            // both client types share the interface but not a base, so the setup is written once for either
+            template< class client_t >
+            void run( client_t& client ) {
+                client.config.timeout_request = m_config.timeout_request;
+                client.config.timeout_idle = m_config.timeout_idle;
+                client.config.max_message_size = m_config.max_message_size;
+                client.config.header = m_config.header;
+                client.config.proxy_server = m_config.proxy_server;
+                client.config.proxy_auth = m_config.proxy_auth;
+                client.config.kernel_tls = m_config.kernel_tls;
+                client.config.session_cache_file = m_config.session_cache_file;
+                client.config.fast_open = m_config.fast_open;
+
+                client.on_open = [ this ] ( std::shared_ptr< typename client_t::Connection > connection ) {
+                    send_t send_message = [ connection ] ( const std::string& message, std::function< void ( ) > on_sent ) {
+                        if ( !on_sent ) {
+                            connection->send( message );
+                            return;
+                        }
+
+                        connection->send( message, [ on_sent = std::move( on_sent ) ] ( const SimpleWeb::error_code& ec ) {
+                            if ( !ec )
+                                on_sent( );
+                        } );
+                    };
+
+                    nlohmann::json resume_request;
+                    {
+                        std::lock_guard< std::mutex > lock( m_mutex );
+                        g_stats.record( phase_t::PHASE_CONNECT, m_track, m_connect_start, stats_clock_t::now( ) );
+                        m_close = [ connection ] ( ) { connection->close( ); };
+
+                        if ( m_resume_id.empty( ) ) {
+                            m_send = std::move( send_message );
+                            m_reconnects = 0;
+                        } else {
+                            // requests wait for the server session to be reattached, see set_resumed
+                            m_resume_send = send_message;
+
+                            resume_request[ "type" ] = 9;
+                            resume_request[ "session_id" ] = m_resume_id;
+                            resume_request[ "username" ] = m_user;
+                            resume_request[ "password" ] = m_pass;
+                        }
+                    }
+
+                    if ( resume_request.is_null( ) )
+                        m_condition.notify_all( );
+                    else
+                        send_message( resume_request.dump( ), nullptr );
+                };
+
+                client.on_message = [ this ] ( std::shared_ptr< typename client_t::Connection >,
+                    std::shared_ptr< typename client_t::InMessage > message ) {
+                    ws_callbacks::on_message( *this, message->string( ) );
+                };
+
+                client.on_close = [ this ] ( std::shared_ptr< typename client_t::Connection > connection, int, const std::string& ) {
+                    on_lost( std::move( connection ) );
+                };
+
+                client.on_error = [ this ] ( std::shared_ptr< typename client_t::Connection > connection, const SimpleWeb::error_code& ) {
+                    on_lost( std::move( connection ) );
+                };
+
+                // with a context set, start( ) only connects and leaves running the context to its owner
+                m_io_context = m_config.io_context ? m_config.io_context : std::make_shared< SimpleWeb::io_context >( );
+                m_reconnect_timer = std::make_unique< SimpleWeb::asio::steady_timer >( *m_io_context );
+                m_reconnect = [ &client ] ( ) { client.start( ); };
+
+                client.io_service = m_io_context;
+                client.start( );
+
+                if ( m_config.io_context )
+                    return;
+
+                for ( size_t index = 0; index < std::max< size_t >( m_config.threads, 1 ); ++index )
+                    m_threads.emplace_back( [ context = m_io_context ] ( ) { context->run( ); } );
+            }
+
+            // runs on the connection's context, for failed connects as well as for dropped connections
+            void on_lost( std::shared_ptr< void > connection ) {
+                std::unique_lock< std::mutex > lock( m_mutex );
+
+                // some connections end with both on_error and on_close
+                if ( connection == m_lost_connection )
+                    return;
+
+                m_lost_connection = std::move( connection );
+                m_send = nullptr;
+                m_resume_send = nullptr;
+                m_close = nullptr;
+
+                // responses of the lost connection never arrive, their waits return
+                ++m_generation;
+                m_packets.clear( );
+                m_status = -1;
+
+                if ( m_resume_id.empty( ) )
+                    m_resume_id = m_session_id;
+
+                if ( m_closing || m_reconnects >= m_config.reconnect_attempts ) {
+                    m_failed = true;
+                    lock.unlock( );
+                    m_condition.notify_all( );
+                    return;
+                }
+
+                auto delay = std::min< std::chrono::milliseconds >( m_config.reconnect_delay * ( 1ll << std::min< size_t >( m_reconnects, 20 ) ),
+                    m_config.reconnect_max_delay );
+                ++m_reconnects;
+                lock.unlock( );
+
+                m_condition.notify_all( );
+
+                // jitter keeps the clients of a restarted server from coming back all at once
+                thread_local std::mt19937 generator( std::random_device{ }( ) );
+                delay = delay / 2 + std::chrono::milliseconds(
+                    std::uniform_int_distribution< long long >( 0, std::max< long long >( delay.count( ) / 2, 0 ) )( generator ) );
+
+                m_reconnect_timer->expires_at( std::chrono::steady_clock::now( ) + delay );
+                m_reconnect_timer->async_wait( [ this, weak = weak_from_this( ) ] ( const SimpleWeb::error_code& ec ) {
+                    auto self = weak.lock( );
+                    if ( ec || !self )
+                        return;
+
+                    {
+                        std::lock_guard< std::mutex > lock( m_mutex );
+                        if ( m_closing )
+                            return;
+
+                        m_connect_start = stats_clock_t::now( );
+                    }
+
+                    m_reconnect( );
+                } );
+            }
+
+            transport_config_t m_config;
+
+            std::unique_ptr< ws_client_t > m_ws_client;
+            std::unique_ptr< wss_client_t > m_wss_client;
+            std::shared_ptr< SimpleWeb::io_context > m_io_context;
+            std::unique_ptr< SimpleWeb::asio::steady_timer > m_reconnect_timer;
+            std::function< void ( ) > m_reconnect;
+            std::vector< std::thread > m_threads;
+
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+
+            using send_t = std::function< void ( const std::string&, std::function< void ( ) > ) >;
+
+            // bound to the open connection, whichever transport it uses
+            send_t m_send;
+            std::function< void ( ) > m_close;
+            std::string m_session_id;
+            int m_status = -1;
+            std::deque< ws_packet_t > m_packets;
+
+            // bumped for every lost connection, requests remember the one they were sent on
+            uint64_t m_generation = 1;
+            uint64_t m_session_epoch = 0;
+            std::shared_ptr< void > m_lost_connection;
+            size_t m_reconnects = 0;
+            bool m_closing = false;
+            bool m_failed = false;
+
+            // session to reattach after a reconnect and the send function held back until it is
+            std::string m_resume_id;
+            send_t m_resume_send;
+            std::string m_user;
+            std::string m_pass;
+
+            uint64_t m_track;
+            // tcp, tls and websocket handshakes, until on_open
+            stats_clock_t::time_point m_connect_start;
 
-    std::thread g_client_thread;
-    std::shared_ptr< ws_client_t::Connection > g_connection = { };
+    };
 
-    ws_client_t g_client( "pzm322.com/ws/mutator", false );
+    std::shared_ptr< c_connection > g_connection;
 
     enum class callback_t {
         CALLBACK_EXPORT_INIT = 0,
@@ -41,7 +568,11 @@ namespace pzm {
     enum class option_t {
         OPTION_SHUFFLE = 0,
         OPTION_PARTITION,
-        OPTION_PARTITION_VALIDATE
+        OPTION_PARTITION_VALIDATE,
+        // send the symbols of the map file inside the image as map_index_t instead of the map text
+        OPTION_MAP_INDEX,
+        // leave resources, debug data and the overlay out of the upload and copy them back into the results, see trim_pe
+        OPTION_TRIM_UPLOAD
     };
 
     enum class status_t {
@@ -49,7 +580,9 @@ namespace pzm {
         STATUS_INVALID_FILE,
         STATUS_MISSING_MAP,
         STATUS_MISSING_BIN,
-        STATUS_INVALID_BIN
+        STATUS_INVALID_BIN,
+        // the connection was gone for good before the server answered
+        STATUS_CONNECTION_LOST
     };
 
     struct export_callback_t {
@@ -62,52 +595,284 @@ namespace pzm {
         }
     };
 
+    struct mapping_result_t {
+        bool succeeded = false;
+        std::vector< std::vector< uint8_t > > binaries;
+    };
+
+    // builds an indexed import table straight from resolved addresses
+    // addresses are ordered module by module, function by function, as iterated in mapper_data[ "imports" ]
+    // ( nlohmann::json orders modules by name, the table names them so the server doesn't depend on it )
+    // the result is passed as client_info[ "import_table" ] = table.to_json( ) instead of client_info[ "imports" ]
+    bool make_import_table( const nlohmann::json& mapper_data, std::vector< uint64_t > addresses, import_table_t& table ) {
+        table.modules.clear( );
+        table.counts.clear( );
+
+        size_t total = 0;
+        for ( const auto& imported_module : mapper_data.at( "imports" ).items( ) ) {
+            table.modules.push_back( imported_module.key( ) );
+            table.counts.push_back( static_cast< uint32_t >( imported_module.value( ).size( ) ) );
+            total += imported_module.value( ).size( );
+        }
+
+        if ( addresses.size( ) != total )
+            return false;
+
+        table.addresses = std::move( addresses );
+        return true;
+    }
+
+    // same as above, resolve is called once per imported function in mapper_data[ "imports" ] order
+    import_table_t make_import_table( const nlohmann::json& mapper_data,
+        const std::function< uint64_t ( const std::string&, const std::string& ) >& resolve ) {
+        import_table_t table;
+        for ( const auto& imported_module : mapper_data.at( "imports" ).items( ) ) {
+            table.modules.push_back( imported_module.key( ) );
+            table.counts.push_back( static_cast< uint32_t >( imported_module.value( ).size( ) ) );
+            for ( const auto& function : imported_module.value( ) )
+                table.addresses.push_back( resolve( imported_module.key( ), function.get< std::string >( ) ) );
+        }
+
+        return table;
+    }
+
+    // a dll and its map file, paired by their common stem
+    struct module_image_t {
+        std::string name;
+        std::vector< uint8_t > pe_binary;
+        std::string map_file;
+
+        pe_image_t image;
+        pe_error_t image_error = pe_error_t::PE_SUCCESS;
+        status_t status = status_t::STATUS_SUCCESS;
+    };
+
+    // headers are checked on the mapped file, so a bad image costs neither a copy nor an upload
+    void load_module( const std::filesystem::path& dll_path, const std::filesystem::path& map_path, module_image_t& module ) {
+        if ( map_path.empty( ) || dll_path.empty( ) ) {
+            module.status = map_path.empty( ) ? status_t::STATUS_MISSING_MAP : status_t::STATUS_MISSING_BIN;
+            return;
+        }
+
+        auto loaded = read_file( dll_path, [ & ] ( std::string_view content ) {
+            std::span< const uint8_t > bytes( reinterpret_cast< const uint8_t* >( content.data( ) ), content.size( ) );
+
+            module.image_error = parse_pe( bytes, module.image );
+            if ( module.image_error == pe_error_t::PE_SUCCESS )
+                module.pe_binary.assign( bytes.begin( ), bytes.end( ) );
+
+            return true;
+        } );
+
+        auto map_loaded = read_file( map_path, [ & ] ( std::string_view content ) {
+            module.map_file.assign( content );
+            return true;
+        } );
+
+        if ( !loaded || !map_loaded )
+            module.status = status_t::STATUS_INVALID_FILE;
+        else if ( module.image_error != pe_error_t::PE_SUCCESS )
+            module.status = status_t::STATUS_INVALID_BIN;
+    }
+
+    // every .dll of a directory paired with the .map of the same stem, sorted by name
+    // a directory holding just one dll and one map is paired whatever their names are
+    // files are read on up to threads threads at once, 0 for one per hardware thread
+    std::vector< module_image_t > load_modules( const std::filesystem::path& directory, size_t threads = 0 ) {
+        std::map< std::string, std::pair< std::filesystem::path, std::filesystem::path > > files;
+        for ( const auto& entry : std::filesystem::directory_iterator( directory ) ) {
+            auto extension = entry.path( ).extension( ).string( );
+            if ( extension == ".dll" )
+                files[ entry.path( ).stem( ).string( ) ].first = entry.path( );
+            else if ( extension == ".map" )
+                files[ entry.path( ).stem( ).string( ) ].second = entry.path( );
+        }
+
+        if ( files.size( ) == 2 ) {
+            auto& first = files.begin( )->second;
+            auto& second = std::next( files.begin( ) )->second;
+            if ( first.first.empty( ) != second.first.empty( ) && first.second.empty( ) != second.second.empty( ) ) {
+                auto paired = std::make_pair( first.first.empty( ) ? second.first : first.first,
+                    first.second.empty( ) ? second.second : first.second );
+
+                files.clear( );
+                files[ paired.first.stem( ).string( ) ] = paired;
+            }
+        }
+
+        std::vector< module_image_t > modules;
+        std::vector< std::pair< std::filesystem::path, std::filesystem::path > > paths;
+        for ( auto& file : files ) {
+            modules.emplace_back( ).name = file.first;
+            paths.push_back( std::move( file.second ) );
+        }
+
+        if ( threads == 0 )
+            threads = std::max( std::thread::hardware_concurrency( ), 1u );
+
+        std::atomic< size_t > next = 0;
+        auto worker = [ & ] ( ) {
+            for ( auto index = next++; index < modules.size( ); index = next++ )
+                load_module( paths[ index ].first, paths[ index ].second, modules[ index ] );
+        };
+
+        std::vector< std::thread > workers;
+        for ( size_t index = 1; index < std::min( threads, modules.size( ) ); ++index )
+            workers.emplace_back( worker );
+
+        worker( );
+        for ( auto& thread : workers )
+            thread.join( );
+
+        return modules;
+    }
+
     class c_mutator {
 
         public:
 
-            void set_directory( const std::string& directory_path ) {
-                if ( !std::filesystem::is_directory( directory_path ) ) {
-                    last_status = status_t::STATUS_INVALID_FILE;
-                    return;
-                }
+            explicit c_mutator( std::shared_ptr< c_connection > connection = g_connection )
+                : m_connection( std::move( connection ) ) {
+                if ( m_connection )
+                    m_connection->set_owner( this );
+            }
 
-                for ( const auto& entry : std::filesystem::directory_iterator( directory_path ) ) {
-                    auto extension = entry.path( ).extension( ).string( );
-                    if ( extension != ".map" && extension != ".dll" )
-                        continue;
+            ~c_mutator( ) {
+                if ( m_connection )
+                    m_connection->release_owner( this );
+            }
 
-                    if ( extension == ".map" ) {
-                        std::stringstream map_stream;
-                        std::ifstream map_file_stream( entry.path( ).string( ) );
-                        map_stream << map_file_stream.rdbuf( );
-                        map_file_stream.close( );
+            // same as set_directory, for images already held in memory
+            void set_image( std::vector< uint8_t > binary, std::string map ) {
+                pe_binary = std::move( binary );
+                map_file = std::move( map );
+                m_map_indexed = false;
+                m_modules.clear( );
+                m_load_status = status_t::STATUS_SUCCESS;
 
-                        map_file = map_stream.str( );
-                    } else {
-                        std::ifstream bin_stream( entry.path( ).string( ), std::ios::binary );
-                        bin_stream.unsetf( std::ios::skipws );
-                        bin_stream.seekg( 0, std::ios::end );
+                m_image_error = pe_binary.empty( ) ? pe_error_t::PE_SUCCESS : parse_pe( pe_binary, m_image );
+
+                if ( map_file.empty( ) )
+                    last_status = status_t::STATUS_MISSING_MAP;
+                else if ( pe_binary.empty( ) )
+                    last_status = status_t::STATUS_MISSING_BIN;
+                else if ( m_image_error != pe_error_t::PE_SUCCESS )
+                    last_status = status_t::STATUS_INVALID_BIN;
+                else
+                    last_status = status_t::STATUS_SUCCESS;
+            }
 
-                        auto bin_size = static_cast< size_t >( bin_stream.tellg( ) );
+            // why the image was rejected with STATUS_INVALID_BIN, see pe_error_name
+            pe_error_t image_error( ) const {
+                return m_image_error;
+            }
 
-                        bin_stream.seekg( 0, std::ios::beg );
-                        pe_binary.resize( bin_size );
-                        pe_binary.insert( pe_binary.begin( ), std::istream_iterator< uint8_t >( bin_stream ),
-                            std::istream_iterator< uint8_t >( ) );
-                    }
+            // symbols of the map file for local lookups, parsed on first use
+            const map_index_t& map_index( ) {
+                if ( !m_map_indexed ) {
+                    parse_map( map_file, m_map_index );
+                    m_map_indexed = true;
                 }
 
-                if ( map_file.empty( ) ) {
-                    last_status = status_t::STATUS_MISSING_MAP;
+                return m_map_index;
+            }
+
+            const std::shared_ptr< c_connection >& connection( ) const {
+                return m_connection;
+            }
+
+            // loads every dll of the directory with its map file, see load_modules
+            // the first module in name order becomes the image, select_module switches to another one
+            // initialize( ) only depends on the selected module, load_status( ) covers the whole directory
+            void set_directory( const std::string& directory_path, size_t threads = 0 ) {
+                m_modules.clear( );
+                pe_binary.clear( );
+                map_file.clear( );
+                m_image = { };
+
+                if ( !std::filesystem::is_directory( directory_path ) ) {
+                    last_status = m_load_status = status_t::STATUS_INVALID_FILE;
                     return;
                 }
 
-                if ( pe_binary.empty( ) ) {
-                    last_status = status_t::STATUS_MISSING_BIN;
+                m_modules = load_modules( directory_path, threads );
+                if ( m_modules.empty( ) ) {
+                    last_status = m_load_status = status_t::STATUS_MISSING_MAP;
                     return;
                 }
+
+                m_module = 0;
+                swap_module( m_modules.front( ) );
+
+                m_load_status = status_t::STATUS_SUCCESS;
+                for ( const auto& module : m_modules ) {
+                    if ( module.status != status_t::STATUS_SUCCESS ) {
+                        m_load_status = module.status;
+                        break;
+                    }
+                }
+            }
+
+            // status of the first module set_directory failed to load, STATUS_SUCCESS once every module loaded
+            status_t load_status( ) const {
+                return m_load_status;
+            }
+
+            // names of the modules loaded by set_directory
+            std::vector< std::string > modules( ) const {
+                std::vector< std::string > names;
+                for ( const auto& module : m_modules )
+                    names.push_back( module.name );
+
+                return names;
+            }
+
+            // makes another module the image, initialize( ) has to be called again before it can be mapped
+            bool select_module( const std::string& name ) {
+                auto it = std::find_if( m_modules.begin( ), m_modules.end( ),
+                    [ & ] ( const module_image_t& module ) { return module.name == name; } );
+
+                if ( it == m_modules.end( ) )
+                    return false;
+
+                auto index = static_cast< size_t >( it - m_modules.begin( ) );
+                if ( index != m_module ) {
+                    swap_module( m_modules[ m_module ] );
+                    m_module = index;
+                    swap_module( m_modules[ m_module ] );
+                }
+
+                return true;
             }
+
+            // maps every module loaded by set_directory in turn within this session:
+            // initialize, get_mapper_data, layout( module, mapper_data, client_info ) to fill in client_info, proceed
+            // stops at the first module that fails, results holds the modules mapped until then keyed by name
+            bool map_modules( const std::function< bool ( const std::string&, const nlohmann::json&, nlohmann::json& ) >& layout,
+                std::map< std::string, mapping_result_t >& results ) {
+                results.clear( );
+                for ( const auto& module : modules( ) ) {
+                    if ( !select_module( module ) || initialize( ) != status_t::STATUS_SUCCESS )
+                        return false;
+
+                    auto mapper_data = get_mapper_data( );
+                    if ( mapper_data.is_null( ) )
+                        return false;
+
+                    nlohmann::json client_info;
+                    client_info[ "client_id" ] = mapper_data.at( "client_id" );
+                    if ( !layout( module, mapper_data, client_info ) )
+                        return false;
+
+                    auto& result = results[ module ];
+                    result.succeeded = proceed( client_info, result.binaries );
+                    if ( !result.succeeded )
+                        return false;
+                }
+
+                return true;
+            }
+
             void add_callback( callback_t callback, const std::function< void ( void* ) >& handler ) {
                 m_callbacks.emplace( std::make_pair( callback, handler ) );
             }
@@ -124,82 +889,440 @@ namespace pzm {
                     case option_t::OPTION_PARTITION_VALIDATE:
                         m_options.verify_partition = value;
                         break;
+                    case option_t::OPTION_MAP_INDEX:
+                        m_options.map_index = value;
+                        break;
+                    case option_t::OPTION_TRIM_UPLOAD:
+                        m_options.trim_upload = value;
+                        break;
                 }
             }
 
+            // opt-in cache of mapping results for workflows where deterministic reuse is acceptable
+            // results of map( ) are keyed by the binary, map file, settings and client layout and reused while
+            // the registered callbacks keep producing the same export values; the upload is then deferred until a miss
+            void enable_cache( const std::string& directory, uint64_t max_size = 1ull << 30 ) {
+                m_cache = std::make_shared< c_result_cache >( directory, max_size );
+            }
+
             status_t initialize( ) {
                 if ( last_status != status_t::STATUS_SUCCESS ) {
-                    g_connection->close( );
+                    m_connection->close( );
                     return last_status;
                 }
 
-                request_status = -1;
-                nlohmann::json init_request;
-
-                init_request[ "session" ] = session_id;
-                init_request[ "type" ] = 1;
-                init_request[ "map" ] = map_file;
-                init_request[ "pe" ] = pe_binary;
-                init_request[ "settings" ][ "shuffle" ] = m_options.shuffle;
-                init_request[ "settings" ][ "partition" ] = m_options.partition;
-                init_request[ "settings" ][ "verify_partition" ] = m_options.verify_partition;
-
-                for ( const auto& callback : m_callbacks )
-                    init_request[ "settings" ][ "callbacks" ].emplace_back( static_cast< int >( callback.first ) );
-
-                g_connection->send( init_request.dump( ) );
-
-                while ( request_status == -1 )
-                    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+                if ( m_cache ) {
+                    m_initialized = false;
+                    return status_t::STATUS_SUCCESS;
+                }
 
-                return static_cast< status_t >( request_status );
+                return upload( );
             }
 
             nlohmann::json get_mapper_data( ) {
                 nlohmann::json request;
-                request[ "session" ] = session_id;
                 request[ "type" ] = 2;
 
-                g_connection->send( request.dump( ) );
-                while ( pending_request.empty( ) )
-                    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+                nlohmann::json mapper_data;
+                exchange( [ & ] ( uint64_t& generation ) {
+                    c_phase_timer timer( phase_t::PHASE_MAPPER_DATA, m_connection->track( ) );
+                    generation = m_connection->send( request );
+                    mapper_data = m_connection->wait_packet( 3, generation );
+                    return !mapper_data.is_null( );
+                } );
 
-                auto mapper_data = pending_request;
-                pending_request.clear( );
                 return mapper_data;
             }
 
             bool proceed( nlohmann::json& mapper_data, std::vector< std::vector< uint8_t > >& binaries ) {
                 nlohmann::json request;
-                request[ "session" ] = session_id;
                 request[ "type" ] = 3;
                 request[ "data" ] = mapper_data;
 
-                g_connection->send( request.dump( ) );
-                while ( pending_request.empty( ) )
-                    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+                nlohmann::json response;
+                auto received = exchange( [ & ] ( uint64_t& generation ) {
+                    c_phase_timer timer( phase_t::PHASE_PROCEED, m_connection->track( ) );
+                    generation = m_connection->send( request );
+                    response = m_connection->wait_packet( 4, generation );
+                    return !response.is_null( );
+                } );
+
+                return received && read_result( response, mapper_data, binaries );
+            }
+
+            // requests mapper data and maps the binary in a single round trip
+            // client_info is built the same way as for proceed, except that client_id is assigned by the server
+            // use it when bases and imports are known before mapper data is received (fixed bases, pre-resolved imports)
+            bool map( nlohmann::json& client_info, nlohmann::json& mapper_data,
+                std::vector< std::vector< uint8_t > >& binaries ) {
+                std::string cache_key;
+                if ( m_cache ) {
+                    cache_key = c_result_cache::make_key( pe_binary, map_file, make_settings( ), client_info );
+
+                    cache_entry_t entry;
+                    if ( m_cache->load( cache_key, entry ) && replay_events( entry.events ) ) {
+                        mapper_data = std::move( entry.mapper_data );
+                        client_info = std::move( entry.client_info );
+                        binaries = std::move( entry.binaries );
+                        return entry.succeeded;
+                    }
+                }
+
+                nlohmann::json request;
+                request[ "type" ] = 6;
+                request[ "data" ] = client_info;
+
+                nlohmann::json response;
+                auto received = exchange( [ & ] ( uint64_t& generation ) {
+                    c_phase_timer timer( phase_t::PHASE_MAP, m_connection->track( ) );
+                    clear_events( );
+                    generation = m_connection->send( request );
+
+                    // server answers with mapper data (type 3) followed by the mapping result (type 4)
+                    mapper_data = m_connection->wait_packet( 3, generation );
+                    if ( mapper_data.is_null( ) )
+                        return false;
+
+                    response = m_connection->wait_packet( 4, generation );
+                    return !response.is_null( );
+                } );
+
+                auto succeeded = received && read_result( response, client_info, binaries );
+
+                if ( m_cache && succeeded ) {
+                    cache_entry_t entry;
+                    entry.succeeded = succeeded;
+                    entry.mapper_data = mapper_data;
+                    entry.client_info = client_info;
+                    entry.binaries = binaries;
+
+                    entry.events = m_init_events;
+                    for ( const auto& event : take_events( ) )
+                        entry.events.push_back( event );
+
+                    m_cache->store( cache_key, entry );
+                }
+
+                return succeeded;
+            }
+
+            // maps the same mutated image for several clients at once
+            // client descriptors are sent in batches of batch_size per request instead of one round trip per client
+            // every client_info is updated the same way as in proceed, results are stored in the same order
+            bool proceed_many( std::span< nlohmann::json > clients, std::vector< mapping_result_t >& results,
+                size_t batch_size = 256 ) {
+                results.clear( );
+                results.resize( clients.size( ) );
+
+                if ( batch_size == 0 )
+                    batch_size = clients.size( );
+
+                std::vector< nlohmann::json > responses;
+                auto received = exchange( [ & ] ( uint64_t& generation ) {
+                    c_phase_timer timer( phase_t::PHASE_BATCH, m_connection->track( ), std::to_string( clients.size( ) ) + " clients" );
+                    responses.clear( );
+
+                    // all batches are sent back-to-back, server answers each of them with a type 7 response in order
+                    size_t batch_count = 0;
+                    for ( size_t offset = 0; offset < clients.size( ); offset += batch_size, ++batch_count ) {
+                        auto batch = clients.subspan( offset, std::min( batch_size, clients.size( ) - offset ) );
+
+                        nlohmann::json request;
+                        request[ "type" ] = 7;
+                        request[ "data" ] = nlohmann::json::array( );
+                        for ( const auto& client_info : batch )
+                            request[ "data" ].push_back( client_info );
+
+                        generation = m_connection->send( request );
+                    }
+
+                    for ( size_t batch = 0; batch < batch_count; ++batch ) {
+                        responses.push_back( m_connection->wait_packet( 7, generation ) );
+                        if ( responses.back( ).is_null( ) )
+                            return false;
+                    }
+
+                    return true;
+                } );
+
+                if ( !received )
+                    return false;
 
-                mapper_data = pending_request.at( "data" ).get< nlohmann::json::object_t >( );
-                auto succeeded = pending_request.at( "succeeded" ).get< bool >( );
-                binaries = pending_request.at( "pe_bin" ).get< std::vector< std::vector< uint8_t > > >( );
+                auto succeeded = true;
+                for ( size_t batch = 0; batch < responses.size( ); ++batch ) {
+                    const auto& entries = responses[ batch ].at( "results" );
+
+                    auto offset = batch * batch_size;
+                    auto count = std::min( batch_size, clients.size( ) - offset );
+                    for ( size_t index = 0; index < count; ++index ) {
+                        auto& result = results[ offset + index ];
+                        if ( index < entries.size( ) )
+                            result.succeeded = read_result( entries.at( index ), clients[ offset + index ], result.binaries );
+
+                        succeeded &= result.succeeded;
+                    }
+                }
 
-                pending_request.clear( );
                 return succeeded;
             }
 
+            // requests the mutated image once as a relocatable template (type 8)
+            // the template is then mapped locally for every client layout, see c_image_template::apply
+            bool get_template( c_image_template& image_template ) {
+                nlohmann::json request;
+                request[ "type" ] = 8;
+
+                nlohmann::json response;
+                auto received = exchange( [ & ] ( uint64_t& generation ) {
+                    c_phase_timer timer( phase_t::PHASE_TEMPLATE, m_connection->track( ) );
+                    generation = m_connection->send( request );
+                    response = m_connection->wait_packet( 8, generation );
+                    return !response.is_null( );
+                } );
+
+                if ( !received || !response.value( "succeeded", false ) )
+                    return false;
+
+                if ( !image_template.parse( response ) )
+                    return false;
+
+                return m_trim.ranges.empty( ) ||
+                    restitch( response.value( "trimmed", nlohmann::json( ) ), m_trim.ranges, pe_binary, image_template.template_regions( ) );
+            }
+
+            // runs a registered callback, the value set by export callbacks is returned in export_binary
+            // with the cache enabled every call is recorded, so results can be matched against the callbacks later
+            bool run_callback( callback_t callback_type, const std::string& name, std::vector< uint8_t >& export_binary,
+                bool record = true ) {
+                auto handler = m_callbacks.find( callback_type );
+                if ( handler == m_callbacks.end( ) )
+                    return false;
+
+                c_phase_timer timer( phase_t::PHASE_CALLBACK, m_connection ? m_connection->track( ) : 0, name );
+
+                switch ( callback_type ) {
+                    case callback_t::CALLBACK_EXPORT_MMAP:
+                    case callback_t::CALLBACK_EXPORT_INIT: {
+                        std::vector< uint8_t > export_storage( 1000 );
+
+                        export_callback_t export_data;
+                        export_data.name = name;
+                        export_data.data = export_storage.data( );
+
+                        handler->second( &export_data );
+
+                        export_binary.resize( export_data.field_size );
+                        memcpy( export_binary.data( ), export_data.data, export_data.field_size );
+                        break;
+                    }
+                    case callback_t::CALLBACK_MMAP_START:
+                    case callback_t::CALLBACK_MMAP_END: {
+                        handler->second( nullptr );
+                        break;
+                    }
+                }
+
+                if ( record && m_cache ) {
+                    nlohmann::json event;
+                    event[ "callback" ] = callback_type;
+                    event[ "name" ] = name;
+                    event[ "bin" ] = export_binary;
+
+                    std::lock_guard< std::mutex > lock( m_events_mutex );
+                    m_events.push_back( std::move( event ) );
+                }
+
+                return true;
+            }
+
             std::unordered_map< callback_t, std::function< void ( void* ) > > m_callbacks = { };
 
         private:
 
+            // the selected module lives in pe_binary and map_file, its entry in m_modules is empty meanwhile
+            void swap_module( module_image_t& module ) {
+                std::swap( pe_binary, module.pe_binary );
+                std::swap( map_file, module.map_file );
+                std::swap( m_image, module.image );
+
+                m_image_error = module.image_error;
+                last_status = module.status;
+                m_map_indexed = false;
+                m_initialized = false;
+                m_trim = { };
+            }
+
+            nlohmann::json make_settings( ) const {
+                nlohmann::json settings;
+                settings[ "shuffle" ] = m_options.shuffle;
+                settings[ "partition" ] = m_options.partition;
+                settings[ "verify_partition" ] = m_options.verify_partition;
+
+                for ( const auto& callback : m_callbacks )
+                    settings[ "callbacks" ].emplace_back( static_cast< int >( callback.first ) );
+
+                return settings;
+            }
+
+            status_t upload( ) {
+                // upload is the time until the image has been written to the socket, including its serialization,
+                // mutation the time from there until the server's answer
+                auto upload_start = stats_clock_t::now( );
+                nlohmann::json init_request;
+
+                init_request[ "type" ] = 1;
+
+                // maps without any symbols the parser recognizes are left to the server
+                if ( m_options.map_index && !map_index( ).symbols.empty( ) )
+                    init_request[ "map_index" ] = map_index( ).relevant( m_image ).to_json( );
+                else
+                    init_request[ "map" ] = map_file;
+
+                // the server reserves room for the trimmed ranges and reports where they are in every result
+                if ( m_options.trim_upload && trim_pe( pe_binary, m_image, m_trim ) ) {
+                    init_request[ "pe" ] = std::move( m_trim.binary );
+                    init_request[ "trimmed" ] = nlohmann::json::array( );
+                    for ( const auto& range : m_trim.ranges )
+                        init_request[ "trimmed" ].push_back( { { "rva", range.rva }, { "size", range.size } } );
+                } else {
+                    m_trim = { };
+                    init_request[ "pe" ] = pe_binary;
+                }
+                init_request[ "settings" ] = make_settings( );
+
+                // the image is sent again if the connection drops before the status arrives
+                auto status = -1;
+                for ( size_t attempt = 0; m_connection->wait_ready( ); ++attempt ) {
+                    clear_events( );
+                    m_session_epoch = m_connection->session_epoch( );
+
+                    auto sent_at = std::make_shared< std::atomic< stats_clock_t::rep > >( 0 );
+                    auto generation = m_connection->send( init_request, [ sent_at ] ( ) {
+                        sent_at->store( stats_clock_t::now( ).time_since_epoch( ).count( ) );
+                    } );
+
+                    status = m_connection->wait_status( generation );
+
+                    auto now = stats_clock_t::now( );
+                    if ( auto sent = sent_at->load( ) ) {
+                        auto sent_time = stats_clock_t::time_point( stats_clock_t::duration( sent ) );
+                        g_stats.record( phase_t::PHASE_UPLOAD, m_connection->track( ), upload_start, sent_time );
+                        if ( status != -1 )
+                            g_stats.record( phase_t::PHASE_MUTATION, m_connection->track( ), sent_time, now );
+                    } else
+                        g_stats.record( phase_t::PHASE_UPLOAD, m_connection->track( ), upload_start, now );
+
+                    if ( status != -1 || !m_connection->lost( generation ) || attempt >= m_connection->config( ).reconnect_attempts )
+                        break;
+
+                    upload_start = stats_clock_t::now( );
+                }
+
+                if ( status == -1 )
+                    status = static_cast< int >( status_t::STATUS_CONNECTION_LOST );
+
+                m_initialized = ( status == static_cast< int >( status_t::STATUS_SUCCESS ) );
+                m_init_events = take_events( );
+                return static_cast< status_t >( status );
+            }
+
+            // a reattached server session still holds the image, a replaced one needs another upload
+            bool ensure_initialized( ) {
+                if ( m_initialized && m_session_epoch == m_connection->session_epoch( ) )
+                    return true;
+
+                return upload( ) == status_t::STATUS_SUCCESS;
+            }
+
+            // runs a request until its responses arrived; requests lost with a dropped connection are sent again
+            // once the connection is back, timeouts on a live connection aren't retried
+            template< class exchange_t >
+            bool exchange( exchange_t run ) {
+                for ( size_t attempt = 0; ; ++attempt ) {
+                    if ( !ensure_initialized( ) )
+                        return false;
+
+                    uint64_t generation = 0;
+                    if ( run( generation ) )
+                        return true;
+
+                    if ( !m_connection->lost( generation ) || attempt >= m_connection->config( ).reconnect_attempts ||
+                        !m_connection->wait_ready( ) )
+                        return false;
+                }
+            }
+
+            void clear_events( ) {
+                std::lock_guard< std::mutex > lock( m_events_mutex );
+                m_events = nlohmann::json::array( );
+            }
+
+            nlohmann::json take_events( ) {
+                std::lock_guard< std::mutex > lock( m_events_mutex );
+                return std::exchange( m_events, nlohmann::json::array( ) );
+            }
+
+            // a cached result is only valid while the callbacks still produce the export values it was built with
+            bool replay_events( const nlohmann::json& events ) {
+                for ( const auto& event : events ) {
+                    std::vector< uint8_t > export_binary = { };
+                    run_callback( event.at( "callback" ).get< callback_t >( ), event.at( "name" ).get< std::string >( ),
+                        export_binary, false );
+
+                    if ( export_binary != event.at( "bin" ).get< std::vector< uint8_t > >( ) )
+                        return false;
+                }
+
+                return true;
+            }
+
+            bool read_result( const nlohmann::json& response, nlohmann::json& client_info,
+                std::vector< std::vector< uint8_t > >& binaries ) const {
+                client_info = response.at( "data" ).get< nlohmann::json::object_t >( );
+                binaries = response.at( "pe_bin" ).get< std::vector< std::vector< uint8_t > > >( );
+
+                // a result without the trimmed data copied back is incomplete
+                if ( !m_trim.ranges.empty( ) &&
+                    !restitch( response.value( "trimmed", nlohmann::json( ) ), m_trim.ranges, pe_binary, binaries ) )
+                    return false;
+
+                return response.at( "succeeded" ).get< bool >( );
+            }
+
             std::vector< uint8_t > pe_binary = { };
             std::string map_file;
 
+            pe_image_t m_image;
+            pe_error_t m_image_error = pe_error_t::PE_SUCCESS;
+
+            map_index_t m_map_index;
+            bool m_map_indexed = false;
+
+            // ranges left out of the last upload
+            pe_trim_t m_trim;
+
+            std::vector< module_image_t > m_modules;
+            size_t m_module = 0;
+            status_t m_load_status = status_t::STATUS_SUCCESS;
+
+            std::shared_ptr< c_connection > m_connection;
+
             status_t last_status = status_t::STATUS_SUCCESS;
+            bool m_initialized = false;
+            uint64_t m_session_epoch = 0;
+
+            std::shared_ptr< c_result_cache > m_cache;
+
+            std::mutex m_events_mutex;
+            nlohmann::json m_events = nlohmann::json::array( );
+            nlohmann::json m_init_events = nlohmann::json::array( );
 
             struct _options {
                 bool shuffle = false;
                 bool partition = false;
                 bool verify_partition = false;
+                bool map_index = false;
+                bool trim_upload = false;
             } m_options;
 
     };
@@ -208,79 +1331,69 @@ namespace pzm {
 
     namespace ws_callbacks {
 
-        void on_message( const std::shared_ptr< ws_client_t::Connection >& connection,
-            const std::shared_ptr< ws_client_t::InMessage >& message ) {
+        void on_message( c_connection& owner, const std::string& message ) {
+            auto parse_start = stats_clock_t::now( );
+
             nlohmann::json request;
             try {
-                std::stringstream( message->string( ) ) >> request;
+                request = nlohmann::json::parse( message );
             } catch ( ... ) {
                 return;
             }
 
+            // images arrive as json arrays, decoding them is a good part of every download
+            g_stats.record( phase_t::PHASE_PARSE, owner.track( ), parse_start, stats_clock_t::now( ) );
+
             if ( !request.contains( "type" ) || !request.at( "type" ).is_number_unsigned( ) )
                 return;
 
             switch ( request.at( "type" ).get< size_t >( ) ) {
                 case 0: {
-                    session_id = request.at( "session_id" ).get< nlohmann::json >( );
+                    owner.set_session( request.at( "session_id" ).get< std::string >( ) );
                     break;
                 }
                 case 1:
                 case 2: {
-                    request_status = request.at( "status" ).get< int >( );
+                    owner.set_status( request.at( "status" ).get< int >( ) );
                     break;
                 }
                 case 3: {
-                    pending_request = request.at( "data" ).get< nlohmann::json::object_t >( );
+                    owner.push_packet( 3, request.at( "data" ).get< nlohmann::json::object_t >( ) );
                     break;
                 }
-                case 4: {
-                    pending_request = request;
+                case 4:
+                case 7:
+                case 8: {
+                    auto packet_id = request.at( "type" ).get< size_t >( );
+                    owner.push_packet( packet_id, std::move( request ) );
+                    break;
+                }
+                case 9: {
+                    owner.set_resumed( request );
                     break;
                 }
                 case 5: {
                     auto callback_type = request.at( "callback" ).get< callback_t >( );
-                    if ( instance->m_callbacks.find( callback_type ) == instance->m_callbacks.end( ) )
-                        break;
+                    auto name = request.value( "name", std::string( ) );
 
-                    void* callback_data = nullptr;
+                    std::vector< uint8_t > export_binary = { };
+                    auto handled = owner.with_owner( [ & ] ( c_mutator& mutator ) {
+                        return mutator.run_callback( callback_type, name, export_binary );
+                    } );
 
-                    nlohmann::json response;
-                    response[ "session" ] = session_id;
-                    response[ "type" ] = 5;
-                    response[ "callback" ] = callback_type;
-
-                    switch ( callback_type ) {
-                        case callback_t::CALLBACK_EXPORT_MMAP:
-                        case callback_t::CALLBACK_EXPORT_INIT: {
-                            auto export_data = new export_callback_t( );
-                            export_data->name = request.at( "name" ).get<
-                                    std::string>( );
-                            export_data->data = malloc( 1000 );
-                            callback_data = reinterpret_cast< void * >( export_data );
-                            break;
-                        }
-                        case callback_t::CALLBACK_MMAP_START:
-                        case callback_t::CALLBACK_MMAP_END: {
-                            break;
-                        }
-                    }
-
-                    instance->m_callbacks.at( callback_type )( callback_data );
+                    if ( !handled )
+                        break;
 
                     switch ( callback_type ) {
                         case callback_t::CALLBACK_EXPORT_MMAP:
                         case callback_t::CALLBACK_EXPORT_INIT: {
-                            auto export_data = reinterpret_cast< export_callback_t* >( callback_data );
-                            response[ "size" ] = export_data->field_size;
-
-                            std::vector< uint8_t > export_binary = { };
-                            export_binary.resize( export_data->field_size );
-                            memcpy( export_binary.data( ), export_data->data, export_data->field_size );
-
+                            nlohmann::json response;
+                            response[ "type" ] = 5;
+                            response[ "callback" ] = callback_type;
+                            response[ "size" ] = export_binary.size( );
                             response[ "bin" ] = export_binary;
 
-                            connection->send( response.dump( ) );
+                            owner.send( std::move( response ) );
                             break;
                         }
                         case callback_t::CALLBACK_MMAP_START:
@@ -295,43 +1408,45 @@ namespace pzm {
 
     }
 
-    bool setup( ) {
-        instance = std::make_shared< c_mutator >( );
+    // plain ws, certificate verification, timeouts or a shared io_context are set through transport
+    bool setup( transport_config_t transport = { } ) {
+        g_connection = std::make_shared< c_connection >( std::move( transport ) );
+        instance = std::make_shared< c_mutator >( g_connection );
 
-        g_client.on_open = [ ] ( const std::shared_ptr< ws_client_t::Connection >& connection ) {
-            g_connection = connection;
-            printf( "opened connection!\n" );
-        };
+        return g_connection->start( );
+    }
 
-        g_client.on_message = ws_callbacks::on_message;
-        g_client_thread = std::thread( [ ] ( ) -> void {
-            g_client.start( );
-        } );
+    // result of the authentication started by prewarm
+    std::shared_future< bool > g_auth;
 
-        return true;
+    bool auth( ) {
+        if ( g_auth.valid( ) )
+            return std::exchange( g_auth, { } ).get( );
+
+        return g_connection->auth( username, password );
     }
 
-    bool auth( ) {
-        while ( !g_connection )
-            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
-
-        nlohmann::json auth_request;
-        auth_request[ "session" ] = session_id;
-        auth_request[ "username" ] = username;
-        auth_request[ "password" ] = password;
-        auth_request[ "type" ] = 0;
-
-        g_connection->send( auth_request.dump( ) );
-        while ( request_status == -1 )
-            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
-
-        auto succeeded = ( request_status == 0 );
-        request_status = -1;
-        return succeeded;
+    // setup followed by an authentication that runs in the background, so that loading the image ( set_directory )
+    // overlaps with the tcp, tls and websocket handshakes; auth( ) then only waits for the result
+    // credentials have to be set before
+    bool prewarm( transport_config_t transport = { } ) {
+        if ( !setup( std::move( transport ) ) )
+            return false;
+
+        // a detached task, unlike std::async, never blocks the exit of a process that didn't wait for it
+        std::packaged_task< bool ( ) > task( [ connection = g_connection, user = username, pass = password ] ( ) {
+            return connection->auth( user, pass );
+        } );
+
+        g_auth = task.get_future( ).share( );
+        std::thread( std::move( task ) ).detach( );
+        return true;
     }
 
     void unload( ) {
-        g_client_thread.detach( );
+        g_connection->detach( );
     }
 
-}
\ No newline at end of file
+}
+
+#endif /* PZM_INST_HPP */
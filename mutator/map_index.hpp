@@ -0,0 +1,293 @@
+#ifndef PZM_MAP_INDEX_HPP
+#define PZM_MAP_INDEX_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "helpers/ws/crypto.hpp"
+#include "helpers/json.hpp"
+
+#include "pe_image.hpp"
+
+namespace pzm {
+
+    namespace map_detail {
+
+        inline void put( char* out, uint32_t value, size_t size ) {
+            for ( size_t byte = 0; byte < size; ++byte )
+                out[ byte ] = static_cast< char >( value >> ( 8 * byte ) );
+        }
+
+        inline uint32_t get( const char* in, size_t size ) {
+            uint32_t value = 0;
+            for ( size_t byte = 0; byte < size; ++byte )
+                value |= static_cast< uint32_t >( static_cast< uint8_t >( in[ byte ] ) ) << ( 8 * byte );
+
+            return value;
+        }
+
+        inline std::string_view next_token( std::string_view& line ) {
+            auto start = line.find_first_not_of( " \t\r" );
+            if ( start == std::string_view::npos ) {
+                line = { };
+                return { };
+            }
+
+            line.remove_prefix( start );
+            auto end = std::min( line.find_first_of( " \t\r" ), line.size( ) );
+            auto token = line.substr( 0, end );
+            line.remove_prefix( end );
+            return token;
+        }
+
+        template< class T >
+        bool hex( std::string_view text, T& value ) {
+            auto [ end, error ] = std::from_chars( text.data( ), text.data( ) + text.size( ), value, 16 );
+            return error == std::errc( ) && end == text.data( ) + text.size( );
+        }
+
+    }
+
+    struct map_symbol_t {
+        enum : uint16_t {
+            FLAG_FUNCTION = 1,
+            FLAG_INLINE = 2,
+            // listed under "Static symbols" instead of "Publics by Value"
+            FLAG_STATIC = 4
+        };
+
+        uint16_t section = 0;
+        uint16_t flags = 0;
+        uint32_t offset = 0;
+        uint32_t rva = 0;
+        // offsets of nul-terminated strings in map_index_t::strings
+        uint32_t name = 0;
+        uint32_t object = 0;
+    };
+
+    // symbols of an msvc .map file, sorted by rva, with names and objects kept in one string pool
+    // replaces init_request[ "map" ] with init_request[ "map_index" ] = index.to_json( ), which is a fraction of the text
+    // and can be limited to the symbols inside the image with relevant( )
+    struct map_index_t {
+        static constexpr size_t record_size = 20;
+
+        uint64_t base = 0;
+        std::vector< map_symbol_t > symbols;
+        std::string strings;
+        // symbol indices sorted by name, rebuilt by build( )
+        std::vector< uint32_t > by_name;
+
+        std::string_view name( const map_symbol_t& symbol ) const {
+            return strings.c_str( ) + symbol.name;
+        }
+
+        std::string_view object( const map_symbol_t& symbol ) const {
+            return strings.c_str( ) + symbol.object;
+        }
+
+        // the symbol an rva belongs to, which is the last one starting at or before it
+        const map_symbol_t* find( uint32_t rva ) const {
+            auto it = std::upper_bound( symbols.begin( ), symbols.end( ), rva,
+                [ ] ( uint32_t value, const map_symbol_t& symbol ) { return value < symbol.rva; } );
+
+            return it == symbols.begin( ) ? nullptr : &*std::prev( it );
+        }
+
+        const map_symbol_t* find( std::string_view symbol_name ) const {
+            auto it = std::lower_bound( by_name.begin( ), by_name.end( ), symbol_name,
+                [ this ] ( uint32_t index, std::string_view value ) { return name( symbols[ index ] ) < value; } );
+
+            if ( it == by_name.end( ) || name( symbols[ *it ] ) != symbol_name )
+                return nullptr;
+
+            return &symbols[ *it ];
+        }
+
+        // only the symbols that lie inside one of the image's sections, absolute and linker symbols are dropped
+        map_index_t relevant( const pe_image_t& image ) const {
+            map_index_t index;
+            index.base = base;
+
+            std::unordered_map< std::string_view, uint32_t > interned;
+            for ( const auto& symbol : symbols ) {
+                if ( !symbol.section || symbol.section > image.sections.size( ) )
+                    continue;
+
+                const auto& section = image.sections[ symbol.section - 1 ];
+                if ( symbol.rva < section.virtual_address ||
+                    symbol.rva - section.virtual_address >= std::max( section.virtual_size, section.raw_size ) )
+                    continue;
+
+                auto copy = symbol;
+                copy.name = index.append( name( symbol ) );
+                copy.object = index.intern( interned, object( symbol ) );
+                index.symbols.push_back( copy );
+            }
+
+            index.build( );
+            return index;
+        }
+
+        // records are packed little-endian as section, flags, offset, rva, name, object and base64 encoded with the pool
+        nlohmann::json to_json( ) const {
+            using namespace map_detail;
+
+            std::string packed( symbols.size( ) * record_size, '\0' );
+            for ( size_t index = 0; index < symbols.size( ); ++index ) {
+                const auto& symbol = symbols[ index ];
+                auto out = &packed[ index * record_size ];
+
+                put( out, symbol.section, 2 );
+                put( out + 2, symbol.flags, 2 );
+                put( out + 4, symbol.offset, 4 );
+                put( out + 8, symbol.rva, 4 );
+                put( out + 12, symbol.name, 4 );
+                put( out + 16, symbol.object, 4 );
+            }
+
+            nlohmann::json index;
+            index[ "base" ] = base;
+            index[ "symbols" ] = SimpleWeb::Crypto::Base64::encode( packed );
+            index[ "strings" ] = SimpleWeb::Crypto::Base64::encode( strings );
+            return index;
+        }
+
+        bool parse( const nlohmann::json& table ) {
+            using namespace map_detail;
+
+            std::string packed;
+            try {
+                base = table.at( "base" ).get< uint64_t >( );
+                packed = SimpleWeb::Crypto::Base64::decode( table.at( "symbols" ).get< std::string >( ) );
+                strings = SimpleWeb::Crypto::Base64::decode( table.at( "strings" ).get< std::string >( ) );
+            } catch ( ... ) {
+                return false;
+            }
+
+            if ( packed.size( ) % record_size != 0 || ( !strings.empty( ) && strings.back( ) != '\0' ) )
+                return false;
+
+            symbols.resize( packed.size( ) / record_size );
+            for ( size_t index = 0; index < symbols.size( ); ++index ) {
+                auto& symbol = symbols[ index ];
+                auto in = &packed[ index * record_size ];
+
+                symbol.section = static_cast< uint16_t >( get( in, 2 ) );
+                symbol.flags = static_cast< uint16_t >( get( in + 2, 2 ) );
+                symbol.offset = get( in + 4, 4 );
+                symbol.rva = get( in + 8, 4 );
+                symbol.name = get( in + 12, 4 );
+                symbol.object = get( in + 16, 4 );
+
+                if ( symbol.name >= strings.size( ) || symbol.object >= strings.size( ) )
+                    return false;
+            }
+
+            if ( !std::is_sorted( symbols.begin( ), symbols.end( ),
+                [ ] ( const map_symbol_t& a, const map_symbol_t& b ) { return a.rva < b.rva; } ) )
+                return false;
+
+            build( );
+            return true;
+        }
+
+        // orders symbols by rva and refreshes the name lookup
+        void build( ) {
+            std::stable_sort( symbols.begin( ), symbols.end( ),
+                [ ] ( const map_symbol_t& a, const map_symbol_t& b ) { return a.rva < b.rva; } );
+
+            by_name.resize( symbols.size( ) );
+            for ( size_t index = 0; index < by_name.size( ); ++index )
+                by_name[ index ] = static_cast< uint32_t >( index );
+
+            std::stable_sort( by_name.begin( ), by_name.end( ),
+                [ this ] ( uint32_t a, uint32_t b ) { return name( symbols[ a ] ) < name( symbols[ b ] ); } );
+        }
+
+        uint32_t append( std::string_view value ) {
+            auto offset = static_cast< uint32_t >( strings.size( ) );
+            strings.append( value );
+            strings.push_back( '\0' );
+            return offset;
+        }
+
+        // views in interned have to outlive the call, they point into the source text or another index
+        uint32_t intern( std::unordered_map< std::string_view, uint32_t >& interned, std::string_view value ) {
+            auto [ it, inserted ] = interned.try_emplace( value, static_cast< uint32_t >( strings.size( ) ) );
+            if ( inserted )
+                append( value );
+
+            return it->second;
+        }
+    };
+
+    // reads the preferred load address and the "Publics by Value" and "Static symbols" tables,
+    // lines of the form 0001:00000010 name 0000000180001010 [f] [i] lib:object
+    // returns false when the text has no symbols at all
+    inline bool parse_map( std::string_view text, map_index_t& index ) {
+        using namespace map_detail;
+
+        index = { };
+        // msvc writes a little under a hundred characters per symbol line
+        std::unordered_map< std::string_view, uint32_t > interned;
+        index.symbols.reserve( text.size( ) / 64 );
+        index.strings.reserve( text.size( ) / 4 );
+        index.intern( interned, { } );
+
+        enum { TABLE_NONE, TABLE_PUBLICS, TABLE_STATICS } table = TABLE_NONE;
+        while ( !text.empty( ) ) {
+            auto end = std::min( text.find( '\n' ), text.size( ) );
+            auto line = text.substr( 0, end );
+            text.remove_prefix( std::min( end + 1, text.size( ) ) );
+
+            // symbol lines are by far the most common, the table headers are only looked for in lines that aren't one
+            if ( table != TABLE_NONE ) {
+                auto rest = line;
+                auto address = next_token( rest );
+                auto name = next_token( rest );
+                auto rva_base = next_token( rest );
+
+                map_symbol_t symbol;
+                uint64_t absolute = 0;
+                if ( address.size( ) > 5 && address[ 4 ] == ':' && !name.empty( ) && hex( address.substr( 0, 4 ), symbol.section ) &&
+                    hex( address.substr( 5 ), symbol.offset ) && hex( rva_base, absolute ) ) {
+                    symbol.rva = absolute >= index.base ? static_cast< uint32_t >( absolute - index.base ) : 0;
+                    symbol.flags = table == TABLE_STATICS ? map_symbol_t::FLAG_STATIC : 0;
+
+                    auto object = next_token( rest );
+                    for ( ; object == "f" || object == "i"; object = next_token( rest ) )
+                        symbol.flags |= object == "f" ? map_symbol_t::FLAG_FUNCTION : map_symbol_t::FLAG_INLINE;
+
+                    // decorated names are close to unique, only objects repeat often enough to be worth a lookup
+                    symbol.name = index.append( name );
+                    symbol.object = index.intern( interned, object );
+                    index.symbols.push_back( symbol );
+                    continue;
+                }
+            }
+
+            constexpr std::string_view preferred = "Preferred load address is ";
+            if ( line.find( "Publics by Value" ) != std::string_view::npos )
+                table = TABLE_PUBLICS;
+            else if ( line.find( "Static symbols" ) != std::string_view::npos )
+                table = TABLE_STATICS;
+            else if ( line.find( "entry point at" ) != std::string_view::npos )
+                table = TABLE_NONE;
+            else if ( auto position = line.find( preferred ); table == TABLE_NONE && position != std::string_view::npos ) {
+                auto rest = line.substr( position + preferred.size( ) );
+                hex( next_token( rest ), index.base );
+            }
+        }
+
+        index.build( );
+        return !index.symbols.empty( );
+    }
+
+}
+
+#endif /* PZM_MAP_INDEX_HPP */
@@ -0,0 +1,56 @@
+#ifndef PZM_MAPPED_FILE_HPP
+#define PZM_MAPPED_FILE_HPP
+
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pzm {
+
+    // hands the whole file to reader, memory-mapped where possible so nothing is copied before reader decides to
+    // returns false for files that can't be opened or are empty, otherwise whatever reader returned
+    template< class F >
+    bool read_file( const std::filesystem::path& path, F&& reader ) {
+#ifndef _WIN32
+        auto fd = open( path.c_str( ), O_RDONLY );
+        if ( fd < 0 )
+            return false;
+
+        struct stat info { };
+        if ( fstat( fd, &info ) != 0 || info.st_size <= 0 ) {
+            close( fd );
+            return false;
+        }
+
+        auto size = static_cast< size_t >( info.st_size );
+        auto mapping = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+
+        if ( mapping == MAP_FAILED )
+            return false;
+
+        auto result = reader( std::string_view( static_cast< const char* >( mapping ), size ) );
+        munmap( mapping, size );
+        return result;
+#else
+        std::ifstream stream( path, std::ios::binary );
+        if ( !stream )
+            return false;
+
+        std::stringstream buffer;
+        buffer << stream.rdbuf( );
+        return reader( std::string_view( buffer.str( ) ) );
+#endif
+    }
+
+}
+
+#endif /* PZM_MAPPED_FILE_HPP */
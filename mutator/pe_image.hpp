@@ -0,0 +1,221 @@
+#ifndef PZM_PE_IMAGE_HPP
+#define PZM_PE_IMAGE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace pzm {
+
+    // why an image was rejected by parse_pe, the mutator would answer all of these with STATUS_INVALID_BIN
+    enum class pe_error_t {
+        PE_SUCCESS = 0,
+        PE_TOO_SMALL,
+        PE_BAD_DOS_HEADER,
+        PE_BAD_NT_SIGNATURE,
+        PE_UNSUPPORTED_MACHINE,
+        PE_NOT_DLL,
+        PE_BAD_OPTIONAL_HEADER,
+        PE_BAD_ALIGNMENT,
+        PE_BAD_SECTION_TABLE,
+        PE_BAD_SECTION,
+        PE_BAD_DATA_DIRECTORY,
+        PE_BAD_ENTRY_POINT
+    };
+
+    constexpr const char* pe_error_name( pe_error_t error ) {
+        constexpr const char* names[ ] = {
+            "success", "too small", "bad dos header", "bad nt signature", "unsupported machine", "not a dll",
+            "bad optional header", "bad alignment", "bad section table", "bad section", "bad data directory",
+            "bad entry point"
+        };
+
+        return names[ static_cast< size_t >( error ) ];
+    }
+
+    struct pe_section_t {
+        std::string name;
+        uint32_t virtual_address = 0;
+        uint32_t virtual_size = 0;
+        uint32_t raw_offset = 0;
+        uint32_t raw_size = 0;
+        uint32_t characteristics = 0;
+    };
+
+    struct pe_directory_t {
+        uint32_t address = 0;
+        uint32_t size = 0;
+    };
+
+    // the header fields the checks are based on, filled in by parse_pe
+    struct pe_image_t {
+        static constexpr size_t directory_security = 4;
+
+        uint16_t machine = 0;
+        uint16_t characteristics = 0;
+        bool is_64 = false;
+        uint64_t image_base = 0;
+        uint32_t entry_point = 0;
+        uint32_t section_alignment = 0;
+        uint32_t file_alignment = 0;
+        uint32_t size_of_image = 0;
+        uint32_t size_of_headers = 0;
+        std::vector< pe_section_t > sections;
+        // rvas, except the certificate table ( directory_security ) which is a file offset
+        std::array< pe_directory_t, 16 > directories = { };
+        // end of the last section's raw data, anything behind it is overlay
+        size_t raw_end = 0;
+    };
+
+    namespace pe_detail {
+
+        template< class T >
+        T read( std::span< const uint8_t > bytes, size_t offset ) {
+            T value;
+            std::memcpy( &value, bytes.data( ) + offset, sizeof( T ) );
+            return value;
+        }
+
+        constexpr bool power_of_two( uint32_t value ) {
+            return value && ( value & ( value - 1 ) ) == 0;
+        }
+
+        constexpr uint64_t align( uint64_t value, uint64_t alignment ) {
+            return ( value + alignment - 1 ) / alignment * alignment;
+        }
+
+        // the loader maps VirtualSize bytes and ignores raw data past them, only a VirtualSize of 0 falls back to the raw size
+        inline uint64_t mapped_size( const pe_section_t& section, uint32_t section_alignment ) {
+            return align( section.virtual_size ? section.virtual_size : section.raw_size, section_alignment );
+        }
+
+    }
+
+    // structural checks of a dll image, roughly what the windows loader insists on before mapping it:
+    // dos and nt headers, i386 or amd64 with the matching optional header, sane alignments,
+    // a section table inside the headers with sections that are ordered, aligned and backed by the file,
+    // and data directories and the entry point inside the image
+    // only headers are read, so it is cheap to run on a mapped file before anything is copied or uploaded
+    inline pe_error_t parse_pe( std::span< const uint8_t > bytes, pe_image_t& image ) {
+        using namespace pe_detail;
+
+        image = { };
+        if ( bytes.size( ) < 0x40 )
+            return pe_error_t::PE_TOO_SMALL;
+
+        // IMAGE_DOS_HEADER
+        if ( read< uint16_t >( bytes, 0 ) != 0x5a4d )
+            return pe_error_t::PE_BAD_DOS_HEADER;
+
+        auto nt = static_cast< size_t >( read< uint32_t >( bytes, 0x3c ) );
+        if ( nt < 0x40 || nt % 4 != 0 || nt > bytes.size( ) || bytes.size( ) - nt < 24 )
+            return pe_error_t::PE_BAD_DOS_HEADER;
+
+        if ( read< uint32_t >( bytes, nt ) != 0x00004550 )
+            return pe_error_t::PE_BAD_NT_SIGNATURE;
+
+        // IMAGE_FILE_HEADER
+        image.machine = read< uint16_t >( bytes, nt + 4 );
+        auto section_count = static_cast< size_t >( read< uint16_t >( bytes, nt + 6 ) );
+        auto optional_size = static_cast< size_t >( read< uint16_t >( bytes, nt + 20 ) );
+        image.characteristics = read< uint16_t >( bytes, nt + 22 );
+
+        if ( image.machine != 0x14c && image.machine != 0x8664 )
+            return pe_error_t::PE_UNSUPPORTED_MACHINE;
+
+        // IMAGE_FILE_EXECUTABLE_IMAGE and IMAGE_FILE_DLL
+        if ( ( image.characteristics & 0x0002 ) == 0 || ( image.characteristics & 0x2000 ) == 0 )
+            return pe_error_t::PE_NOT_DLL;
+
+        // IMAGE_OPTIONAL_HEADER32 / IMAGE_OPTIONAL_HEADER64 up to NumberOfRvaAndSizes
+        auto optional = nt + 24;
+        image.is_64 = image.machine == 0x8664;
+        size_t fixed_size = image.is_64 ? 112 : 96;
+        if ( optional_size < fixed_size || bytes.size( ) - optional < optional_size )
+            return pe_error_t::PE_BAD_OPTIONAL_HEADER;
+
+        if ( read< uint16_t >( bytes, optional ) != ( image.is_64 ? 0x20b : 0x10b ) )
+            return pe_error_t::PE_BAD_OPTIONAL_HEADER;
+
+        image.entry_point = read< uint32_t >( bytes, optional + 16 );
+        image.image_base = image.is_64 ? read< uint64_t >( bytes, optional + 24 ) : read< uint32_t >( bytes, optional + 28 );
+        image.section_alignment = read< uint32_t >( bytes, optional + 32 );
+        image.file_alignment = read< uint32_t >( bytes, optional + 36 );
+        image.size_of_image = read< uint32_t >( bytes, optional + 56 );
+        image.size_of_headers = read< uint32_t >( bytes, optional + 60 );
+        auto directory_count = static_cast< size_t >( read< uint32_t >( bytes, optional + fixed_size - 4 ) );
+
+        if ( directory_count > image.directories.size( ) || optional_size < fixed_size + directory_count * 8 )
+            return pe_error_t::PE_BAD_OPTIONAL_HEADER;
+
+        if ( !power_of_two( image.file_alignment ) || !power_of_two( image.section_alignment ) ||
+            image.file_alignment < 0x200 || image.file_alignment > 0x10000 || image.section_alignment < image.file_alignment )
+            return pe_error_t::PE_BAD_ALIGNMENT;
+
+        // IMAGE_SECTION_HEADER table right after the optional header and inside the headers
+        auto section_table = optional + optional_size;
+        if ( section_count == 0 || section_count > 96 || section_table + section_count * 40 > image.size_of_headers ||
+            image.size_of_headers > bytes.size( ) || image.size_of_headers > image.size_of_image )
+            return pe_error_t::PE_BAD_SECTION_TABLE;
+
+        uint64_t next_address = align( image.size_of_headers, image.section_alignment );
+        image.raw_end = image.size_of_headers;
+        for ( size_t index = 0; index < section_count; ++index ) {
+            auto header = section_table + index * 40;
+
+            pe_section_t section;
+            auto name = reinterpret_cast< const char* >( bytes.data( ) + header );
+            section.name.assign( name, strnlen( name, 8 ) );
+            section.virtual_size = read< uint32_t >( bytes, header + 8 );
+            section.virtual_address = read< uint32_t >( bytes, header + 12 );
+            section.raw_size = read< uint32_t >( bytes, header + 16 );
+            section.raw_offset = read< uint32_t >( bytes, header + 20 );
+            section.characteristics = read< uint32_t >( bytes, header + 36 );
+
+            // sections follow each other in memory without overlapping, each one starting on a page of its own
+            if ( section.virtual_address != next_address || section.virtual_address % image.section_alignment != 0 )
+                return pe_error_t::PE_BAD_SECTION;
+
+            next_address = section.virtual_address + mapped_size( section, image.section_alignment );
+            if ( next_address > image.size_of_image )
+                return pe_error_t::PE_BAD_SECTION;
+
+            if ( section.raw_size ) {
+                if ( section.raw_offset % image.file_alignment != 0 || section.raw_offset < image.size_of_headers ||
+                    static_cast< uint64_t >( section.raw_offset ) + section.raw_size > bytes.size( ) )
+                    return pe_error_t::PE_BAD_SECTION;
+
+                image.raw_end = std::max< size_t >( image.raw_end, section.raw_offset + section.raw_size );
+            }
+
+            image.sections.push_back( std::move( section ) );
+        }
+
+        for ( size_t index = 0; index < directory_count; ++index ) {
+            auto& directory = image.directories[ index ];
+            directory.address = read< uint32_t >( bytes, optional + fixed_size + index * 8 );
+            directory.size = read< uint32_t >( bytes, optional + fixed_size + index * 8 + 4 );
+
+            if ( !directory.address && !directory.size )
+                continue;
+
+            auto end = static_cast< uint64_t >( directory.address ) + directory.size;
+            auto limit = index == pe_image_t::directory_security ? bytes.size( ) : image.size_of_image;
+            if ( !directory.address || end > limit )
+                return pe_error_t::PE_BAD_DATA_DIRECTORY;
+        }
+
+        // resource only dlls have no entry point
+        if ( image.entry_point && ( image.entry_point < image.size_of_headers || image.entry_point >= image.size_of_image ) )
+            return pe_error_t::PE_BAD_ENTRY_POINT;
+
+        return pe_error_t::PE_SUCCESS;
+    }
+
+}
+
+#endif /* PZM_PE_IMAGE_HPP */
@@ -0,0 +1,231 @@
+#ifndef PZM_PE_TRIM_HPP
+#define PZM_PE_TRIM_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "helpers/json.hpp"
+
+#include "pe_image.hpp"
+
+namespace pzm {
+
+    // part of the mapped image that was left out of the upload, the server only reserves room for it
+    // and reports where it ended up, so the bytes can be copied back from the local image
+    struct trimmed_range_t {
+        uint32_t rva = 0;
+        uint32_t size = 0;
+        // where the bytes are in the untrimmed file
+        uint32_t file_offset = 0;
+    };
+
+    struct pe_trim_t {
+        std::vector< uint8_t > binary;
+        std::vector< trimmed_range_t > ranges;
+        // file bytes behind the last section ( certificate table, installers' payloads ), never mapped so never restored
+        size_t overlay = 0;
+    };
+
+    namespace trim_detail {
+
+        constexpr size_t directory_resource = 2;
+        constexpr size_t directory_debug = 6;
+
+        template< class T >
+        void put( std::vector< uint8_t >& bytes, size_t offset, T value ) {
+            std::memcpy( bytes.data( ) + offset, &value, sizeof( T ) );
+        }
+
+        // file offset of an rva inside a section's raw data, or nothing
+        inline bool to_file_offset( const pe_image_t& image, uint64_t rva, uint64_t size, size_t& offset ) {
+            for ( const auto& section : image.sections ) {
+                if ( rva >= section.virtual_address && rva + size <= static_cast< uint64_t >( section.virtual_address ) + section.raw_size ) {
+                    offset = static_cast< size_t >( section.raw_offset + ( rva - section.virtual_address ) );
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    }
+
+    // leaves out what the mutator has no use for, image is the result of parse_pe on bytes:
+    // the resource section's raw data ( the section stays in the headers and is mapped zero-filled ),
+    // codeview and other debug data referenced by the debug directory ( zeroed in place ),
+    // and the overlay including an appended certificate table
+    // sections behind a removed one are moved down in the file and raw offsets in the headers are fixed up
+    // returns false when there is nothing to leave out, the image is then uploaded as it is
+    inline bool trim_pe( std::span< const uint8_t > bytes, const pe_image_t& image, pe_trim_t& trim ) {
+        using namespace trim_detail;
+
+        trim = { };
+
+        auto nt = static_cast< size_t >( pe_detail::read< uint32_t >( bytes, 0x3c ) );
+        auto optional = nt + 24;
+        auto directories = optional + ( image.is_64 ? 112 : 96 );
+        auto section_table = optional + pe_detail::read< uint16_t >( bytes, nt + 20 );
+
+        // the resource section is dropped only when it holds nothing but resources
+        auto resource_section = image.sections.size( );
+        const auto& resources = image.directories[ directory_resource ];
+        for ( size_t index = 0; resources.address && index < image.sections.size( ); ++index ) {
+            const auto& section = image.sections[ index ];
+            if ( section.virtual_address != resources.address || !section.raw_size )
+                continue;
+
+            auto section_end = section.virtual_address + pe_detail::mapped_size( section, image.section_alignment );
+            auto shared = image.entry_point >= section.virtual_address && image.entry_point < section_end;
+            for ( size_t directory = 0; directory < image.directories.size( ); ++directory ) {
+                const auto& entry = image.directories[ directory ];
+                if ( directory != directory_resource && directory != pe_image_t::directory_security && entry.address &&
+                    entry.address < section_end && static_cast< uint64_t >( entry.address ) + entry.size > section.virtual_address )
+                    shared = true;
+            }
+
+            if ( !shared )
+                resource_section = index;
+            break;
+        }
+
+        trim.overlay = bytes.size( ) - image.raw_end;
+
+        // entries of the debug directory, their data is zeroed when it lies in a section and dropped with the overlay otherwise
+        std::vector< size_t > debug_entries;
+        const auto& debug = image.directories[ directory_debug ];
+        size_t debug_table = 0;
+        if ( debug.address && to_file_offset( image, debug.address, debug.size, debug_table ) ) {
+            for ( size_t entry = debug_table; entry + 28 <= debug_table + debug.size; entry += 28 )
+                debug_entries.push_back( entry );
+        }
+
+        if ( resource_section == image.sections.size( ) && debug_entries.empty( ) && !trim.overlay )
+            return false;
+
+        // new file layout: headers, then the raw data of every kept section in file order
+        std::vector< size_t > order;
+        for ( size_t index = 0; index < image.sections.size( ); ++index ) {
+            if ( image.sections[ index ].raw_size && index != resource_section )
+                order.push_back( index );
+        }
+
+        std::sort( order.begin( ), order.end( ), [ & ] ( size_t a, size_t b ) {
+            return image.sections[ a ].raw_offset < image.sections[ b ].raw_offset;
+        } );
+
+        std::vector< uint32_t > new_offsets( image.sections.size( ), 0 );
+        size_t file_size = pe_detail::align( image.size_of_headers, image.file_alignment );
+        for ( auto index : order ) {
+            new_offsets[ index ] = static_cast< uint32_t >( file_size );
+            file_size = pe_detail::align( file_size + image.sections[ index ].raw_size, image.file_alignment );
+        }
+
+        auto& binary = trim.binary;
+        binary.assign( file_size, 0 );
+        std::memcpy( binary.data( ), bytes.data( ), image.size_of_headers );
+        for ( auto index : order ) {
+            const auto& section = image.sections[ index ];
+            std::memcpy( binary.data( ) + new_offsets[ index ], bytes.data( ) + section.raw_offset, section.raw_size );
+        }
+
+        // moves a file offset along with the section it lies in, offsets outside of the kept sections become 0
+        auto relocate = [ & ] ( size_t offset ) -> uint32_t {
+            for ( auto index : order ) {
+                const auto& section = image.sections[ index ];
+                if ( offset >= section.raw_offset && offset < static_cast< size_t >( section.raw_offset ) + section.raw_size )
+                    return static_cast< uint32_t >( offset - section.raw_offset + new_offsets[ index ] );
+            }
+
+            return 0;
+        };
+
+        for ( size_t index = 0; index < image.sections.size( ); ++index ) {
+            const auto& section = image.sections[ index ];
+            auto header = section_table + index * 40;
+
+            if ( index == resource_section ) {
+                // without raw data the loader maps virtual size bytes of zeros, a virtual size of 0 has to
+                // take over the raw size so the section keeps its extent
+                if ( !section.virtual_size )
+                    put< uint32_t >( binary, header + 8, section.raw_size );
+
+                put< uint32_t >( binary, header + 16, 0 );
+                put< uint32_t >( binary, header + 20, 0 );
+
+                // only the raw data inside the mapped part of the section ends up in the image
+                auto size = section.virtual_size ? std::min( section.virtual_size, section.raw_size ) : section.raw_size;
+                trim.ranges.push_back( { section.virtual_address, size, section.raw_offset } );
+            } else if ( section.raw_size )
+                put< uint32_t >( binary, header + 20, new_offsets[ index ] );
+        }
+
+        for ( auto entry : debug_entries ) {
+            auto size = pe_detail::read< uint32_t >( bytes, entry + 16 );
+            auto rva = pe_detail::read< uint32_t >( bytes, entry + 20 );
+            auto offset = pe_detail::read< uint32_t >( bytes, entry + 24 );
+
+            auto moved_entry = relocate( entry );
+            auto moved_offset = size && static_cast< uint64_t >( offset ) + size <= image.raw_end ? relocate( offset ) : 0;
+            if ( !moved_entry )
+                continue;
+
+            put< uint32_t >( binary, moved_entry + 24, moved_offset );
+            if ( !moved_offset || relocate( offset + size - 1 ) != moved_offset + size - 1 )
+                continue;
+
+            std::memset( binary.data( ) + moved_offset, 0, size );
+            if ( rva )
+                trim.ranges.push_back( { rva, size, offset } );
+        }
+
+        // the entries point at file offsets of the trimmed file now, the mapped image gets the original ones back
+        if ( !debug_entries.empty( ) && relocate( debug_table ) )
+            trim.ranges.push_back( { debug.address, debug.size, static_cast< uint32_t >( debug_table ) } );
+
+        // the certificate table is the only directory holding a file offset, it is normally appended to the file
+        const auto& security = image.directories[ pe_image_t::directory_security ];
+        if ( security.address ) {
+            auto moved = security.address < image.raw_end ? relocate( security.address ) : 0;
+            put< uint32_t >( binary, directories + pe_image_t::directory_security * 8, moved );
+            put< uint32_t >( binary, directories + pe_image_t::directory_security * 8 + 4, moved ? security.size : 0 );
+        }
+
+        // CheckSum no longer matches, it is only verified for drivers and boot images
+        put< uint32_t >( binary, optional + 64, 0 );
+        return true;
+    }
+
+    // placements[ i ] holds the region and offset the server put ranges[ i ] at
+    inline bool restitch( const nlohmann::json& placements, const std::vector< trimmed_range_t >& ranges,
+        std::span< const uint8_t > original, std::vector< std::vector< uint8_t > >& binaries ) {
+        if ( !placements.is_array( ) || placements.size( ) != ranges.size( ) )
+            return false;
+
+        for ( size_t index = 0; index < ranges.size( ); ++index ) {
+            const auto& range = ranges[ index ];
+
+            size_t region = 0;
+            size_t offset = 0;
+            try {
+                region = placements.at( index ).at( "region" ).get< size_t >( );
+                offset = placements.at( index ).at( "offset" ).get< size_t >( );
+            } catch ( ... ) {
+                return false;
+            }
+
+            if ( region >= binaries.size( ) || offset > binaries[ region ].size( ) || binaries[ region ].size( ) - offset < range.size ||
+                static_cast< uint64_t >( range.file_offset ) + range.size > original.size( ) )
+                return false;
+
+            std::memcpy( binaries[ region ].data( ) + offset, original.data( ) + range.file_offset, range.size );
+        }
+
+        return true;
+    }
+
+}
+
+#endif /* PZM_PE_TRIM_HPP */
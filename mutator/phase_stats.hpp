@@ -0,0 +1,283 @@
+#ifndef PZM_PHASE_STATS_HPP
+#define PZM_PHASE_STATS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "helpers/json.hpp"
+
+namespace pzm {
+
+    using stats_clock_t = std::chrono::steady_clock;
+
+    enum class phase_t {
+        PHASE_CONNECT = 0,
+        PHASE_AUTH,
+        PHASE_UPLOAD,
+        PHASE_MUTATION,
+        PHASE_MAPPER_DATA,
+        PHASE_CALLBACK,
+        PHASE_PROCEED,
+        PHASE_MAP,
+        PHASE_BATCH,
+        PHASE_TEMPLATE,
+        PHASE_PARSE,
+        PHASE_COUNT
+    };
+
+    constexpr const char* phase_name( phase_t phase ) {
+        constexpr const char* names[ ] = {
+            "connect", "auth", "upload", "mutation", "mapper_data", "callback",
+            "proceed", "map", "batch", "template", "parse"
+        };
+
+        return names[ static_cast< size_t >( phase ) ];
+    }
+
+    // latencies in nanoseconds with a fixed relative error, like an hdr histogram:
+    // every power of two is split into 64 buckets, so a recorded value is off by at most 1.6%
+    // values above ~18 minutes land in the last bucket; recording is a few relaxed atomic increments
+    class c_latency_histogram {
+
+        public:
+
+            void record( uint64_t value ) {
+                value = std::min( value, max_value );
+
+                m_counts[ index( value ) ].fetch_add( 1, std::memory_order_relaxed );
+                m_count.fetch_add( 1, std::memory_order_relaxed );
+                m_sum.fetch_add( value, std::memory_order_relaxed );
+
+                auto max = m_max.load( std::memory_order_relaxed );
+                while ( value > max && !m_max.compare_exchange_weak( max, value, std::memory_order_relaxed ) ) { }
+            }
+
+            uint64_t count( ) const {
+                return m_count.load( std::memory_order_relaxed );
+            }
+
+            uint64_t max( ) const {
+                return m_max.load( std::memory_order_relaxed );
+            }
+
+            double mean( ) const {
+                auto total = count( );
+                return total ? static_cast< double >( m_sum.load( std::memory_order_relaxed ) ) / static_cast< double >( total ) : 0.0;
+            }
+
+            // smallest value that at least the given fraction ( 0..1 ) of the recorded values doesn't exceed,
+            // reported as the upper end of its bucket
+            uint64_t percentile( double fraction ) const {
+                auto total = count( );
+                if ( total == 0 )
+                    return 0;
+
+                // nearest rank, rounded up so p99 of 10 values is the largest one,
+                // the product is shaved first as 0.99 * 100 comes out a hair above 99
+                auto exact = std::clamp( fraction, 0.0, 1.0 ) * static_cast< double >( total ) * ( 1.0 - 1e-12 );
+                auto rank = std::clamp< uint64_t >( static_cast< uint64_t >( std::ceil( exact ) ), 1, total );
+
+                uint64_t seen = 0;
+                for ( size_t bucket = 0; bucket < bucket_count; ++bucket ) {
+                    seen += m_counts[ bucket ].load( std::memory_order_relaxed );
+                    if ( seen >= rank )
+                        return std::min( highest_value( bucket ), max( ) );
+                }
+
+                return max( );
+            }
+
+            void reset( ) {
+                for ( auto& counter : m_counts )
+                    counter.store( 0, std::memory_order_relaxed );
+
+                m_count.store( 0, std::memory_order_relaxed );
+                m_sum.store( 0, std::memory_order_relaxed );
+                m_max.store( 0, std::memory_order_relaxed );
+            }
+
+            // microseconds, as that's the scale of every phase
+            nlohmann::json to_json( ) const {
+                auto us = [ ] ( double ns ) { return ns / 1000.0; };
+
+                nlohmann::json summary;
+                summary[ "count" ] = count( );
+                summary[ "mean_us" ] = us( mean( ) );
+                summary[ "p50_us" ] = us( static_cast< double >( percentile( 0.5 ) ) );
+                summary[ "p90_us" ] = us( static_cast< double >( percentile( 0.9 ) ) );
+                summary[ "p99_us" ] = us( static_cast< double >( percentile( 0.99 ) ) );
+                summary[ "p999_us" ] = us( static_cast< double >( percentile( 0.999 ) ) );
+                summary[ "max_us" ] = us( static_cast< double >( max( ) ) );
+                return summary;
+            }
+
+        private:
+
+            static constexpr unsigned sub_bits = 6;
+            static constexpr uint64_t sub_count = 1ull << sub_bits;
+            static constexpr uint64_t max_value = ( 1ull << 40 ) - 1;
+            // values below 2 * sub_count have a bucket each, every further power of two adds sub_count buckets
+            static constexpr size_t bucket_count = 2 * sub_count + ( 40 - sub_bits - 1 ) * sub_count;
+
+            static size_t index( uint64_t value ) {
+                if ( value < 2 * sub_count )
+                    return static_cast< size_t >( value );
+
+                auto shift = static_cast< unsigned >( std::bit_width( value ) ) - sub_bits - 1;
+                return static_cast< size_t >( 2 * sub_count + ( shift - 1 ) * sub_count + ( value >> shift ) - sub_count );
+            }
+
+            static uint64_t highest_value( size_t bucket ) {
+                if ( bucket < 2 * sub_count )
+                    return bucket;
+
+                auto offset = bucket - 2 * sub_count;
+                auto shift = offset / sub_count + 1;
+                return ( ( sub_count + offset % sub_count ) << shift ) + ( 1ull << shift ) - 1;
+            }
+
+            std::array< std::atomic< uint64_t >, bucket_count > m_counts = { };
+            std::atomic< uint64_t > m_count = 0;
+            std::atomic< uint64_t > m_sum = 0;
+            std::atomic< uint64_t > m_max = 0;
+
+    };
+
+    // chrome trace event file ( chrome://tracing, perfetto ), one complete event per phase
+    // tracks are sessions: every connection gets its own row
+    class c_trace_sink {
+
+        public:
+
+            explicit c_trace_sink( const std::filesystem::path& file ) : m_stream( file, std::ios::trunc ),
+                m_epoch( stats_clock_t::now( ) ) {
+                m_stream << "{\"traceEvents\":[\n";
+            }
+
+            ~c_trace_sink( ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_stream << "\n]}\n";
+            }
+
+            void event( phase_t phase, uint64_t track, stats_clock_t::time_point start, stats_clock_t::time_point end,
+                const std::string& detail ) {
+                nlohmann::json event;
+                event[ "name" ] = detail.empty( ) ? phase_name( phase ) : std::string( phase_name( phase ) ) + " " + detail;
+                event[ "cat" ] = phase_name( phase );
+                event[ "ph" ] = "X";
+                event[ "ts" ] = std::chrono::duration< double, std::micro >( start - m_epoch ).count( );
+                event[ "dur" ] = std::chrono::duration< double, std::micro >( end - start ).count( );
+                event[ "pid" ] = 1;
+                event[ "tid" ] = track;
+
+                auto line = event.dump( );
+
+                std::lock_guard< std::mutex > lock( m_mutex );
+                if ( !m_first )
+                    m_stream << ",\n";
+
+                m_first = false;
+                m_stream << line;
+            }
+
+        private:
+
+            std::mutex m_mutex;
+            std::ofstream m_stream;
+            stats_clock_t::time_point m_epoch;
+            bool m_first = true;
+
+    };
+
+    // latency of every phase of every session in the process, see g_stats
+    class c_phase_stats {
+
+        public:
+
+            void record( phase_t phase, uint64_t track, stats_clock_t::time_point start, stats_clock_t::time_point end,
+                const std::string& detail = std::string( ) ) {
+                auto elapsed = std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count( );
+                m_histograms[ static_cast< size_t >( phase ) ].record( static_cast< uint64_t >( std::max< int64_t >( elapsed, 0 ) ) );
+
+                if ( auto sink = std::atomic_load( &m_trace ) )
+                    sink->event( phase, track, start, end, detail );
+            }
+
+            const c_latency_histogram& histogram( phase_t phase ) const {
+                return m_histograms[ static_cast< size_t >( phase ) ];
+            }
+
+            // { "<phase>": { "count", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us" } } for every phase seen so far
+            nlohmann::json snapshot( ) const {
+                nlohmann::json phases = nlohmann::json::object( );
+                for ( size_t phase = 0; phase < m_histograms.size( ); ++phase ) {
+                    if ( m_histograms[ phase ].count( ) )
+                        phases[ phase_name( static_cast< phase_t >( phase ) ) ] = m_histograms[ phase ].to_json( );
+                }
+
+                return phases;
+            }
+
+            void reset( ) {
+                for ( auto& histogram : m_histograms )
+                    histogram.reset( );
+            }
+
+            // writes every recorded phase to the sink as well, nullptr stops tracing;
+            // the file is completed once the last reference to the sink is gone
+            void set_trace( std::shared_ptr< c_trace_sink > sink ) {
+                std::atomic_store( &m_trace, std::move( sink ) );
+            }
+
+            uint64_t next_track( ) {
+                return m_next_track.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+        private:
+
+            std::array< c_latency_histogram, static_cast< size_t >( phase_t::PHASE_COUNT ) > m_histograms;
+            std::shared_ptr< c_trace_sink > m_trace;
+            std::atomic< uint64_t > m_next_track = 1;
+
+    };
+
+    c_phase_stats g_stats;
+
+    // records the time until it goes out of scope
+    class c_phase_timer {
+
+        public:
+
+            c_phase_timer( phase_t phase, uint64_t track, std::string detail = std::string( ) )
+                : m_phase( phase ), m_track( track ), m_detail( std::move( detail ) ), m_start( stats_clock_t::now( ) ) { }
+
+            ~c_phase_timer( ) {
+                g_stats.record( m_phase, m_track, m_start, stats_clock_t::now( ), m_detail );
+            }
+
+            c_phase_timer( const c_phase_timer& ) = delete;
+            c_phase_timer& operator=( const c_phase_timer& ) = delete;
+
+        private:
+
+            phase_t m_phase;
+            uint64_t m_track;
+            std::string m_detail;
+            stats_clock_t::time_point m_start;
+
+    };
+
+}
+
+#endif /* PZM_PHASE_STATS_HPP */
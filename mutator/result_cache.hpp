@@ -0,0 +1,254 @@
+#ifndef PZM_RESULT_CACHE_HPP
+#define PZM_RESULT_CACHE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+#include <openssl/evp.h>
+
+#include "helpers/ws/crypto.hpp"
+#include "helpers/json.hpp"
+
+#include "mapped_file.hpp"
+
+namespace pzm {
+
+    struct cache_entry_t {
+        bool succeeded = false;
+
+        nlohmann::json mapper_data;
+        nlohmann::json client_info;
+
+        // callbacks triggered by the server while the entry was produced, in order, with the export values sent back
+        nlohmann::json events = nlohmann::json::array( );
+
+        std::vector< std::vector< uint8_t > > binaries;
+    };
+
+    // on-disk storage of mutation and mapping results, one file per key
+    // entries are memory-mapped for reads and the directory is kept under max_size by evicting least recently used files
+    class c_result_cache {
+
+        public:
+
+            c_result_cache( std::filesystem::path directory, uint64_t max_size )
+                : m_directory( std::move( directory ) ), m_max_size( max_size ) {
+                std::error_code error;
+                std::filesystem::create_directories( m_directory, error );
+            }
+
+            // the key covers everything that changes the server output, except for client_id which is assigned by the server
+            static std::string make_key( const std::vector< uint8_t >& pe_binary, const std::string& map_file,
+                const nlohmann::json& settings, nlohmann::json client_info ) {
+                client_info.erase( "client_id" );
+
+                auto settings_dump = settings.dump( );
+                auto client_dump = client_info.dump( );
+
+                std::string digest( EVP_MAX_MD_SIZE, '\0' );
+                unsigned int digest_length = 0;
+
+                auto ctx = EVP_MD_CTX_create( );
+                EVP_DigestInit_ex( ctx, EVP_sha256( ), nullptr );
+
+                auto update = [ ctx ] ( const void* data, size_t size ) {
+                    uint64_t length = size;
+                    EVP_DigestUpdate( ctx, &length, sizeof( length ) );
+                    EVP_DigestUpdate( ctx, data, size );
+                };
+
+                update( pe_binary.data( ), pe_binary.size( ) );
+                update( map_file.data( ), map_file.size( ) );
+                update( settings_dump.data( ), settings_dump.size( ) );
+                update( client_dump.data( ), client_dump.size( ) );
+
+                EVP_DigestFinal_ex( ctx, reinterpret_cast< unsigned char* >( &digest[ 0 ] ), &digest_length );
+                EVP_MD_CTX_destroy( ctx );
+
+                digest.resize( digest_length );
+                return SimpleWeb::Crypto::to_hex_string( digest );
+            }
+
+            bool load( const std::string& key, cache_entry_t& entry ) {
+                auto path = entry_path( key );
+
+                if ( !read_file( path, [ & ] ( std::string_view content ) { return deserialize( content, entry ); } ) )
+                    return false;
+
+                // touching the file keeps it at the end of the eviction order
+                std::error_code error;
+                std::filesystem::last_write_time( path, std::filesystem::file_time_type::clock::now( ), error );
+                return true;
+            }
+
+            void store( const std::string& key, const cache_entry_t& entry ) {
+                auto path = entry_path( key );
+                auto temporary = path;
+                temporary += ".tmp";
+
+                {
+                    std::ofstream stream( temporary, std::ios::binary | std::ios::trunc );
+                    if ( !stream )
+                        return;
+
+                    auto content = serialize( entry );
+                    stream.write( content.data( ), static_cast< std::streamsize >( content.size( ) ) );
+                    if ( !stream )
+                        return;
+                }
+
+                std::error_code error;
+                std::filesystem::rename( temporary, path, error );
+                if ( error ) {
+                    std::filesystem::remove( temporary, error );
+                    return;
+                }
+
+                evict( );
+            }
+
+        private:
+
+            static constexpr uint32_t magic = 0x434d5a50; // PZMC
+            static constexpr uint32_t version = 1;
+
+            std::filesystem::path entry_path( const std::string& key ) const {
+                return m_directory / ( key + ".pzc" );
+            }
+
+            void evict( ) {
+                struct file_t {
+                    std::filesystem::path path;
+                    std::filesystem::file_time_type time;
+                    uint64_t size;
+                };
+
+                std::vector< file_t > files;
+                uint64_t total_size = 0;
+
+                std::error_code error;
+                for ( const auto& entry : std::filesystem::directory_iterator( m_directory, error ) ) {
+                    if ( entry.path( ).extension( ) != ".pzc" )
+                        continue;
+
+                    std::error_code entry_error;
+                    auto size = entry.file_size( entry_error );
+                    auto time = entry.last_write_time( entry_error );
+                    if ( entry_error )
+                        continue;
+
+                    files.push_back( { entry.path( ), time, size } );
+                    total_size += size;
+                }
+
+                if ( total_size <= m_max_size )
+                    return;
+
+                std::sort( files.begin( ), files.end( ), [ ] ( const file_t& a, const file_t& b ) { return a.time < b.time; } );
+                for ( const auto& file : files ) {
+                    if ( total_size <= m_max_size )
+                        break;
+
+                    if ( std::filesystem::remove( file.path, error ) )
+                        total_size -= file.size;
+                }
+            }
+
+            template< class T >
+            static void write_value( std::string& out, T value ) {
+                out.append( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+            }
+
+            template< class T >
+            static bool read_value( std::string_view in, size_t& offset, T& value ) {
+                if ( in.size( ) - offset < sizeof( T ) )
+                    return false;
+
+                memcpy( &value, in.data( ) + offset, sizeof( T ) );
+                offset += sizeof( T );
+                return true;
+            }
+
+            // layout: magic, version, json header length, json header, binary count, { size, bytes } for every binary
+            static std::string serialize( const cache_entry_t& entry ) {
+                nlohmann::json header;
+                header[ "succeeded" ] = entry.succeeded;
+                header[ "mapper_data" ] = entry.mapper_data;
+                header[ "client_info" ] = entry.client_info;
+                header[ "events" ] = entry.events;
+                auto header_dump = header.dump( );
+
+                std::string out;
+                write_value( out, magic );
+                write_value( out, version );
+                write_value( out, static_cast< uint64_t >( header_dump.size( ) ) );
+                out += header_dump;
+
+                write_value( out, static_cast< uint64_t >( entry.binaries.size( ) ) );
+                for ( const auto& binary : entry.binaries ) {
+                    write_value( out, static_cast< uint64_t >( binary.size( ) ) );
+                    out.append( reinterpret_cast< const char* >( binary.data( ) ), binary.size( ) );
+                }
+
+                return out;
+            }
+
+            // binaries are copied straight out of the mapped file
+            static bool deserialize( std::string_view in, cache_entry_t& entry ) {
+                size_t offset = 0;
+                uint32_t file_magic = 0, file_version = 0;
+                uint64_t header_size = 0, binary_count = 0;
+
+                if ( !read_value( in, offset, file_magic ) || !read_value( in, offset, file_version ) )
+                    return false;
+
+                if ( file_magic != magic || file_version != version )
+                    return false;
+
+                if ( !read_value( in, offset, header_size ) || in.size( ) - offset < header_size )
+                    return false;
+
+                try {
+                    auto header = nlohmann::json::parse( in.begin( ) + static_cast< std::ptrdiff_t >( offset ),
+                        in.begin( ) + static_cast< std::ptrdiff_t >( offset + header_size ) );
+
+                    entry.succeeded = header.at( "succeeded" ).get< bool >( );
+                    entry.mapper_data = header.at( "mapper_data" );
+                    entry.client_info = header.at( "client_info" );
+                    entry.events = header.at( "events" );
+                } catch ( ... ) {
+                    return false;
+                }
+
+                offset += header_size;
+                if ( !read_value( in, offset, binary_count ) )
+                    return false;
+
+                entry.binaries.clear( );
+                for ( uint64_t index = 0; index < binary_count; ++index ) {
+                    uint64_t size = 0;
+                    if ( !read_value( in, offset, size ) || in.size( ) - offset < size )
+                        return false;
+
+                    auto begin = reinterpret_cast< const uint8_t* >( in.data( ) ) + offset;
+                    entry.binaries.emplace_back( begin, begin + size );
+                    offset += size;
+                }
+
+                return true;
+            }
+
+            std::filesystem::path m_directory;
+            uint64_t m_max_size;
+
+    };
+
+}
+
+#endif /* PZM_RESULT_CACHE_HPP */
@@ -0,0 +1,205 @@
+#ifndef PZM_SESSION_POOL_HPP
+#define PZM_SESSION_POOL_HPP
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "inst.hpp"
+
+namespace pzm {
+
+    struct pool_config_t {
+        // refilling starts once fewer sessions than low_watermark are ready and stops at high_watermark
+        size_t low_watermark = 2;
+        size_t high_watermark = 8;
+
+        // ready sessions older than this are dropped, the server may have discarded them already
+        std::chrono::seconds expiry = std::chrono::minutes( 10 );
+
+        // number of sessions initialized concurrently
+        size_t workers = 2;
+
+        // delay before the next attempt after a session failed to connect, auth or initialize
+        std::chrono::milliseconds retry_delay = std::chrono::seconds( 1 );
+
+        // every session opens its own connection with these settings
+        transport_config_t transport;
+    };
+
+    // keeps initialized sessions of one image and options set ready ahead of demand,
+    // so that serving an end user only takes proceed( ) and mutation stays off the request path
+    class c_session_pool {
+
+        public:
+
+            // configure is called for every new session before initialize( ) and should load the image,
+            // set options and add callbacks, exactly as it's done for pzm::instance
+            c_session_pool( std::function< void ( c_mutator& ) > configure, pool_config_t config = { } )
+                : m_configure( std::move( configure ) ), m_config( std::move( config ) ) {
+                if ( m_config.high_watermark < m_config.low_watermark )
+                    m_config.high_watermark = m_config.low_watermark;
+            }
+
+            ~c_session_pool( ) {
+                stop( );
+            }
+
+            void start( ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                if ( m_running )
+                    return;
+
+                m_running = true;
+                m_refilling = true;
+                for ( size_t index = 0; index < std::max< size_t >( m_config.workers, 1 ); ++index )
+                    m_workers.emplace_back( [ this ] ( ) { worker( ); } );
+            }
+
+            void stop( ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    m_running = false;
+                }
+
+                m_condition.notify_all( );
+                for ( auto& worker : m_workers )
+                    worker.join( );
+
+                m_workers.clear( );
+
+                // sessions are destroyed outside the lock, that joins their connections' threads
+                std::deque< entry_t > ready;
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    ready.swap( m_ready );
+                }
+            }
+
+            // takes a ready session, waiting up to timeout for one to become available
+            // every session is handed out once, returns nullptr if none became ready in time
+            std::shared_ptr< c_mutator > acquire( std::chrono::milliseconds timeout = std::chrono::milliseconds( 0 ) ) {
+                // declared before the lock, so expired sessions are destroyed after it is released
+                std::vector< entry_t > expired;
+                std::unique_lock< std::mutex > lock( m_mutex );
+
+                auto deadline = std::chrono::steady_clock::now( ) + timeout;
+                std::shared_ptr< c_mutator > session;
+                while ( !session ) {
+                    drop_expired( expired );
+
+                    if ( !m_ready.empty( ) ) {
+                        session = std::move( m_ready.front( ).session );
+                        m_ready.pop_front( );
+                        break;
+                    }
+
+                    if ( !m_running || m_condition.wait_until( lock, deadline ) == std::cv_status::timeout )
+                        break;
+                }
+
+                if ( m_ready.size( ) < m_config.low_watermark )
+                    m_refilling = true;
+
+                lock.unlock( );
+                m_condition.notify_all( );
+                return session;
+            }
+
+            size_t ready( ) {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                return m_ready.size( );
+            }
+
+        private:
+
+            struct entry_t {
+                std::shared_ptr< c_mutator > session;
+                std::chrono::steady_clock::time_point created;
+            };
+
+            // moves expired sessions out to be destroyed by the caller once m_mutex is released,
+            // tearing down a connection joins its threads and would hold up every acquire( ) meanwhile
+            void drop_expired( std::vector< entry_t >& expired ) {
+                auto now = std::chrono::steady_clock::now( );
+                while ( !m_ready.empty( ) && now - m_ready.front( ).created > m_config.expiry ) {
+                    expired.push_back( std::move( m_ready.front( ) ) );
+                    m_ready.pop_front( );
+                }
+            }
+
+            std::shared_ptr< c_mutator > create_session( ) {
+                auto connection = std::make_shared< c_connection >( m_config.transport );
+                if ( !connection->start( ) || !connection->auth( username, password ) )
+                    return nullptr;
+
+                auto session = std::make_shared< c_mutator >( connection );
+                m_configure( *session );
+
+                if ( session->initialize( ) != status_t::STATUS_SUCCESS )
+                    return nullptr;
+
+                return session;
+            }
+
+            void worker( ) {
+                std::unique_lock< std::mutex > lock( m_mutex );
+                while ( m_running ) {
+                    std::vector< entry_t > expired;
+                    drop_expired( expired );
+                    if ( !expired.empty( ) ) {
+                        lock.unlock( );
+                        expired.clear( );
+                        lock.lock( );
+                        continue;
+                    }
+
+                    if ( m_ready.size( ) + m_pending >= m_config.high_watermark )
+                        m_refilling = false;
+
+                    if ( !m_refilling ) {
+                        // expiry has to be checked even while nobody takes sessions
+                        m_condition.wait_for( lock, std::chrono::seconds( 1 ) );
+                        if ( m_ready.size( ) < m_config.low_watermark )
+                            m_refilling = true;
+
+                        continue;
+                    }
+
+                    ++m_pending;
+                    lock.unlock( );
+
+                    auto session = create_session( );
+
+                    lock.lock( );
+                    --m_pending;
+
+                    if ( !session ) {
+                        m_condition.wait_for( lock, m_config.retry_delay );
+                        continue;
+                    }
+
+                    m_ready.push_back( { std::move( session ), std::chrono::steady_clock::now( ) } );
+                    m_condition.notify_all( );
+                }
+            }
+
+            std::function< void ( c_mutator& ) > m_configure;
+            pool_config_t m_config;
+
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+
+            bool m_running = false;
+            bool m_refilling = false;
+            size_t m_pending = 0;
+
+            std::deque< entry_t > m_ready;
+            std::vector< std::thread > m_workers;
+
+    };
+
+}
+
+#endif /* PZM_SESSION_POOL_HPP */
@@ -0,0 +1,142 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "mutator/helpers/ws/crypto.hpp"
+
+// compares the handshake crypto of the websocket helpers with the openssl bio / evp path they replaced,
+// checks that both produce the same output first
+//
+// usage: crypto_bench [iterations]
+
+namespace openssl_path {
+
+    std::string base64_encode( const std::string& input ) {
+        std::string base64;
+
+        auto bptr = BUF_MEM_new( );
+        auto b64 = BIO_new( BIO_f_base64( ) );
+        BIO_set_flags( b64, BIO_FLAGS_BASE64_NO_NL );
+        auto bio = BIO_new( BIO_s_mem( ) );
+        BIO_push( b64, bio );
+        BIO_set_mem_buf( b64, bptr, BIO_CLOSE );
+
+        base64.resize( ( input.size( ) + 2 ) / 3 * 4 );
+        bptr->length = 0;
+        bptr->max = base64.size( ) + 1;
+        bptr->data = &base64[ 0 ];
+
+        if ( BIO_write( b64, input.data( ), static_cast< int >( input.size( ) ) ) <= 0 || BIO_flush( b64 ) <= 0 )
+            base64.clear( );
+
+        bptr->length = 0;
+        bptr->max = 0;
+        bptr->data = nullptr;
+        BIO_free_all( b64 );
+
+        return base64;
+    }
+
+    std::string base64_decode( const std::string& base64 ) {
+        std::string ascii( ( 6 * base64.size( ) ) / 8, '\0' );
+
+        auto b64 = BIO_new( BIO_f_base64( ) );
+        BIO_set_flags( b64, BIO_FLAGS_BASE64_NO_NL );
+        auto bio = BIO_push( b64, BIO_new_mem_buf( base64.data( ), static_cast< int >( base64.size( ) ) ) );
+
+        auto length = BIO_read( bio, &ascii[ 0 ], static_cast< int >( ascii.size( ) ) );
+        ascii.resize( length > 0 ? static_cast< size_t >( length ) : 0 );
+
+        BIO_free_all( b64 );
+        return ascii;
+    }
+
+    std::string websocket_accept( const std::string& key ) {
+        return base64_encode( SimpleWeb::Crypto::sha1( key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" ) );
+    }
+
+}
+
+double measure( size_t iterations, const std::function< size_t ( ) >& body ) {
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now( );
+    for ( size_t index = 0; index < iterations; ++index )
+        sink += body( );
+
+    std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now( ) - start;
+
+    // keeps the loop from being optimized out
+    if ( sink == 1 )
+        printf( " " );
+
+    return elapsed.count( ) / static_cast< double >( iterations );
+}
+
+void report( const char* name, double openssl_ns, double inhouse_ns ) {
+    printf( "%-24s openssl %9.1f ns   in-house %9.1f ns   x%.1f\n", name, openssl_ns, inhouse_ns, openssl_ns / inhouse_ns );
+}
+
+int main( int argc, char** argv ) {
+    size_t iterations = argc > 1 ? std::stoul( argv[ 1 ] ) : 200000;
+
+    std::mt19937 generator( 322 );
+    auto random_string = [ & ] ( size_t size ) {
+        std::string result( size, '\0' );
+        for ( auto& byte : result )
+            byte = static_cast< char >( generator( ) );
+        return result;
+    };
+
+    for ( size_t size = 0; size < 300; ++size ) {
+        auto input = random_string( size );
+        auto encoded = SimpleWeb::Crypto::Base64::encode( input );
+
+        if ( encoded != openssl_path::base64_encode( input ) || SimpleWeb::Crypto::Base64::decode( encoded ) != input ||
+            openssl_path::base64_decode( encoded ) != input ) {
+            printf( "base64 mismatch for %zu bytes\n", size );
+            return 1;
+        }
+
+    }
+
+    auto nonce = random_string( 16 );
+    auto key = SimpleWeb::Crypto::Base64::encode( nonce );
+    if ( SimpleWeb::Crypto::websocket_accept( key ) != openssl_path::websocket_accept( key ) ) {
+        printf( "websocket accept mismatch\n" );
+        return 1;
+    }
+
+    auto payload = random_string( 4096 );
+    auto encoded_payload = SimpleWeb::Crypto::Base64::encode( payload );
+
+    report( "base64 encode 16 B",
+        measure( iterations, [ & ] ( ) { return openssl_path::base64_encode( nonce ).size( ); } ),
+        measure( iterations, [ & ] ( ) { return SimpleWeb::Crypto::Base64::encode( nonce ).size( ); } ) );
+
+    report( "base64 encode 4 KiB",
+        measure( iterations / 10, [ & ] ( ) { return openssl_path::base64_encode( payload ).size( ); } ),
+        measure( iterations / 10, [ & ] ( ) { return SimpleWeb::Crypto::Base64::encode( payload ).size( ); } ) );
+
+    report( "base64 decode 4 KiB",
+        measure( iterations / 10, [ & ] ( ) { return openssl_path::base64_decode( encoded_payload ).size( ); } ),
+        measure( iterations / 10, [ & ] ( ) { return SimpleWeb::Crypto::Base64::decode( encoded_payload ).size( ); } ) );
+
+    // the handshake hashes with the one-shot SHA1( ), sha1( ) goes through an EVP context
+    report( "sha1 60 B",
+        measure( iterations, [ & ] ( ) { return SimpleWeb::Crypto::sha1( key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" ).size( ); } ),
+        measure( iterations, [ & ] ( ) {
+            auto input = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+            unsigned char digest[ SHA_DIGEST_LENGTH ];
+            ::SHA1( reinterpret_cast< const unsigned char* >( input.data( ) ), input.size( ), digest );
+            return static_cast< size_t >( digest[ 0 ] );
+        } ) );
+
+    report( "handshake accept",
+        measure( iterations, [ & ] ( ) { return openssl_path::websocket_accept( key ).size( ); } ),
+        measure( iterations, [ & ] ( ) { return SimpleWeb::Crypto::websocket_accept( key ).size( ); } ) );
+
+    return 0;
+}
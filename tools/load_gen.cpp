@@ -0,0 +1,362 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mutator/inst.hpp"
+#include "synthetic_pe.hpp"
+
+extern char** environ;
+
+// drives simulated jobs through the sdk against a local mutator ( mock_server ) to find out how many concurrent sessions
+// one process sustains and where latency bends
+//
+// a job is what a client runs per build: initialize ( upload and mutation with its export callbacks ), get_mapper_data
+// and proceed; jobs are spread over the connections, every connection runs one job at a time on its own session
+// --connections takes a list, every entry is run as its own level with the same number of jobs
+//
+// export counts, callback and mutation latencies and the mapped image size are properties of the server:
+// with --mock the given mock_server is started with them on the endpoint's port, otherwise they're up to the running one
+//
+// --resource-size and --overlay-size add a resource section and an overlay to the image, --trim 1 leaves them out of
+// the upload ( OPTION_TRIM_UPLOAD ), upload_mb_per_s always counts the whole image
+//
+// usage: load_gen [--endpoint localhost:8080/ws/mutator] [--secure 0] [--connections 1,4,16] [--jobs 64]
+//                 [--pe-size 1048576] [--map-size 65536] [--resource-size 0] [--overlay-size 0] [--trim 0] [--threads 1]
+//                 [--mock path/to/mock_server] [--exports 4] [--callback-latency-ms 0] [--latency-ms 0]
+//                 [--region-size 65536] [--cert file --key file]
+
+struct load_config_t {
+    std::string endpoint = "localhost:8080/ws/mutator";
+    bool secure = false;
+    std::vector< size_t > connections = { 1, 4, 16 };
+    size_t jobs = 64;
+
+    size_t pe_size = 1024 * 1024;
+    size_t map_size = 64 * 1024;
+    size_t resource_size = 0;
+    size_t overlay_size = 0;
+    bool trim = false;
+    // io threads of every connection
+    size_t threads = 1;
+
+    std::string mock;
+    size_t exports = 4;
+    size_t callback_latency_ms = 0;
+    size_t latency_ms = 0;
+    size_t region_size = 64 * 1024;
+    std::string certificate;
+    std::string private_key;
+};
+
+load_config_t g_config;
+
+// peak resident set size in KiB, reset_peak_rss starts a new peak where the kernel supports it ( linux 4.0+ )
+void reset_peak_rss( ) {
+    std::ofstream( "/proc/self/clear_refs" ) << "5";
+}
+
+size_t peak_rss( ) {
+    std::ifstream status( "/proc/self/status" );
+    for ( std::string line; std::getline( status, line ); ) {
+        if ( line.rfind( "VmHWM:", 0 ) == 0 )
+            return std::stoul( line.substr( 6 ) );
+    }
+
+    rusage usage = { };
+    getrusage( RUSAGE_SELF, &usage );
+    return static_cast< size_t >( usage.ru_maxrss );
+}
+
+class c_mock_process {
+
+    public:
+
+        // returns false if the server couldn't be started or doesn't accept connections within a few seconds
+        bool start( unsigned short port ) {
+            std::vector< std::string > arguments = {
+                g_config.mock, "--port", std::to_string( port ),
+                "--exports", std::to_string( g_config.exports ),
+                "--callback-latency-ms", std::to_string( g_config.callback_latency_ms ),
+                "--latency-ms", std::to_string( g_config.latency_ms ),
+                "--region-size", std::to_string( g_config.region_size ),
+                "--threads", std::to_string( std::max< size_t >( std::thread::hardware_concurrency( ), 1 ) )
+            };
+
+            if ( g_config.secure ) {
+                arguments.insert( arguments.end( ), { "--cert", g_config.certificate, "--key", g_config.private_key } );
+            }
+
+            std::vector< char* > argv;
+            for ( auto& argument : arguments )
+                argv.push_back( argument.data( ) );
+            argv.push_back( nullptr );
+
+            if ( posix_spawn( &m_pid, g_config.mock.c_str( ), nullptr, nullptr, argv.data( ), environ ) != 0 ) {
+                m_pid = 0;
+                return false;
+            }
+
+            SimpleWeb::io_context context;
+            for ( size_t attempt = 0; attempt < 100; ++attempt ) {
+                SimpleWeb::asio::ip::tcp::socket socket( context );
+                SimpleWeb::error_code ec;
+                socket.connect( SimpleWeb::asio::ip::tcp::endpoint( SimpleWeb::make_address( "127.0.0.1" ), port ), ec );
+                if ( !ec )
+                    return true;
+
+                std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            }
+
+            return false;
+        }
+
+        ~c_mock_process( ) {
+            if ( m_pid <= 0 )
+                return;
+
+            kill( m_pid, SIGTERM );
+            waitpid( m_pid, nullptr, 0 );
+        }
+
+    private:
+
+        pid_t m_pid = 0;
+
+};
+
+// one level of the sweep: jobs spread over the given number of connections
+nlohmann::json run_level( size_t connection_count, const std::vector< uint8_t >& pe, const std::string& map ) {
+    pzm::transport_config_t transport;
+    transport.endpoint = g_config.endpoint;
+    transport.secure = g_config.secure;
+    transport.threads = g_config.threads;
+
+    pzm::g_stats.reset( );
+    reset_peak_rss( );
+
+    pzm::c_latency_histogram latency;
+    std::atomic< size_t > next_job = 0;
+    std::atomic< size_t > failed = 0;
+    std::atomic< size_t > downloaded = 0;
+
+    auto worker = [ & ] ( ) {
+        auto connection = std::make_shared< pzm::c_connection >( transport );
+        if ( !connection->start( ) || !connection->auth( "load_gen", "load_gen" ) ) {
+            // the jobs this connection would have run are left to the others
+            failed.fetch_add( 1 );
+            return;
+        }
+
+        pzm::c_mutator mutator( connection );
+        mutator.set_option( pzm::option_t::OPTION_TRIM_UPLOAD, g_config.trim );
+        mutator.set_image( pe, map );
+
+        auto export_value = [ ] ( void* data ) {
+            auto details = reinterpret_cast< pzm::export_callback_t* >( data );
+            uint32_t value = 0x12345;
+            std::memcpy( details->data, &value, sizeof( value ) );
+        };
+        mutator.add_callback( pzm::callback_t::CALLBACK_EXPORT_INIT, export_value );
+        mutator.add_callback( pzm::callback_t::CALLBACK_EXPORT_MMAP, export_value );
+
+        while ( next_job.fetch_add( 1 ) < g_config.jobs ) {
+            auto start = pzm::stats_clock_t::now( );
+
+            auto succeeded = mutator.initialize( ) == pzm::status_t::STATUS_SUCCESS;
+
+            nlohmann::json client_info;
+            if ( succeeded ) {
+                auto mapper_data = mutator.get_mapper_data( );
+                succeeded = !mapper_data.is_null( );
+
+                if ( succeeded ) {
+                    client_info[ "client_id" ] = mapper_data.at( "client_id" );
+
+                    uint64_t base = 0x10000000;
+                    for ( const auto& size : mapper_data.at( "sizes" ) ) {
+                        client_info[ "bases" ].push_back( base );
+                        base += ( size.get< uint64_t >( ) + 0xffff ) & ~0xffffull;
+                    }
+
+                    client_info[ "import_table" ] = pzm::make_import_table( mapper_data,
+                        [ ] ( const std::string&, const std::string& ) -> uint64_t { return 0x77000000; } ).to_json( );
+                }
+            }
+
+            std::vector< std::vector< uint8_t > > binaries;
+            succeeded = succeeded && mutator.proceed( client_info, binaries );
+
+            if ( !succeeded ) {
+                failed.fetch_add( 1 );
+                continue;
+            }
+
+            latency.record( static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                pzm::stats_clock_t::now( ) - start ).count( ) ) );
+
+            for ( const auto& binary : binaries )
+                downloaded.fetch_add( binary.size( ) );
+        }
+
+        connection->stop( );
+    };
+
+    auto start = pzm::stats_clock_t::now( );
+
+    std::vector< std::thread > workers;
+    for ( size_t index = 0; index < connection_count; ++index )
+        workers.emplace_back( worker );
+
+    for ( auto& thread : workers )
+        thread.join( );
+
+    auto seconds = std::chrono::duration< double >( pzm::stats_clock_t::now( ) - start ).count( );
+    auto completed = latency.count( );
+    auto ms = [ ] ( uint64_t ns ) { return static_cast< double >( ns ) / 1e6; };
+
+    nlohmann::json level;
+    level[ "connections" ] = connection_count;
+    level[ "jobs" ] = completed;
+    level[ "failed" ] = failed.load( );
+    level[ "seconds" ] = seconds;
+    level[ "jobs_per_s" ] = static_cast< double >( completed ) / seconds;
+    level[ "upload_mb_per_s" ] = static_cast< double >( completed * ( pe.size( ) + map.size( ) ) ) / seconds / 1e6;
+    level[ "download_mb_per_s" ] = static_cast< double >( downloaded.load( ) ) / seconds / 1e6;
+    level[ "latency_ms" ] = {
+        { "mean", latency.mean( ) / 1e6 },
+        { "p50", ms( latency.percentile( 0.5 ) ) },
+        { "p90", ms( latency.percentile( 0.9 ) ) },
+        { "p99", ms( latency.percentile( 0.99 ) ) },
+        { "p999", ms( latency.percentile( 0.999 ) ) },
+        { "max", ms( latency.max( ) ) }
+    };
+    level[ "peak_rss_kib" ] = peak_rss( );
+    level[ "phases" ] = pzm::g_stats.snapshot( );
+
+    fprintf( stderr, "%4zu connections: %6zu jobs %8.1f jobs/s  p50 %8.2f ms  p99 %8.2f ms  p999 %8.2f ms  peak rss %zu KiB\n",
+        connection_count, static_cast< size_t >( completed ), level[ "jobs_per_s" ].get< double >( ),
+        ms( latency.percentile( 0.5 ) ), ms( latency.percentile( 0.99 ) ), ms( latency.percentile( 0.999 ) ), peak_rss( ) );
+
+    return level;
+}
+
+std::vector< size_t > parse_list( const std::string& value ) {
+    std::vector< size_t > values;
+    std::stringstream stream( value );
+    for ( std::string entry; std::getline( stream, entry, ',' ); ) {
+        if ( !entry.empty( ) )
+            values.push_back( std::max< size_t >( std::stoul( entry ), 1 ) );
+    }
+
+    return values;
+}
+
+unsigned short endpoint_port( ) {
+    auto host_port = g_config.endpoint.substr( 0, g_config.endpoint.find( '/' ) );
+    auto colon = host_port.rfind( ':' );
+    if ( colon == std::string::npos )
+        return g_config.secure ? 443 : 80;
+
+    return static_cast< unsigned short >( std::stoul( host_port.substr( colon + 1 ) ) );
+}
+
+int main( int argc, char** argv ) {
+    for ( int index = 1; index + 1 < argc; index += 2 ) {
+        std::string option = argv[ index ];
+        std::string value = argv[ index + 1 ];
+
+        if ( option == "--endpoint" )
+            g_config.endpoint = value;
+        else if ( option == "--secure" )
+            g_config.secure = value != "0";
+        else if ( option == "--connections" )
+            g_config.connections = parse_list( value );
+        else if ( option == "--jobs" )
+            g_config.jobs = std::stoul( value );
+        else if ( option == "--pe-size" )
+            g_config.pe_size = std::stoul( value );
+        else if ( option == "--map-size" )
+            g_config.map_size = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--resource-size" )
+            g_config.resource_size = std::stoul( value );
+        else if ( option == "--overlay-size" )
+            g_config.overlay_size = std::stoul( value );
+        else if ( option == "--trim" )
+            g_config.trim = value != "0";
+        else if ( option == "--threads" )
+            g_config.threads = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--mock" )
+            g_config.mock = value;
+        else if ( option == "--exports" )
+            g_config.exports = std::stoul( value );
+        else if ( option == "--callback-latency-ms" )
+            g_config.callback_latency_ms = std::stoul( value );
+        else if ( option == "--latency-ms" )
+            g_config.latency_ms = std::stoul( value );
+        else if ( option == "--region-size" )
+            g_config.region_size = std::stoul( value );
+        else if ( option == "--cert" )
+            g_config.certificate = value;
+        else if ( option == "--key" )
+            g_config.private_key = value;
+        else {
+            printf( "unknown option %s\n", option.c_str( ) );
+            return 1;
+        }
+    }
+
+    if ( g_config.connections.empty( ) ) {
+        printf( "no connection counts given\n" );
+        return 1;
+    }
+
+    std::unique_ptr< c_mock_process > mock;
+    if ( !g_config.mock.empty( ) ) {
+        mock = std::make_unique< c_mock_process >( );
+        if ( !mock->start( endpoint_port( ) ) ) {
+            printf( "failed to start %s\n", g_config.mock.c_str( ) );
+            return 1;
+        }
+    }
+
+    auto pe = synthetic_pe::make( g_config.pe_size, 322, g_config.resource_size, g_config.overlay_size );
+    std::string map( g_config.map_size, ' ' );
+
+    nlohmann::json report;
+    report[ "config" ] = {
+        { "endpoint", g_config.endpoint },
+        { "secure", g_config.secure },
+        { "jobs", g_config.jobs },
+        { "pe_size", pe.size( ) },
+        { "map_size", map.size( ) },
+        { "trim", g_config.trim },
+        { "threads", g_config.threads }
+    };
+
+    if ( mock ) {
+        report[ "config" ][ "server" ] = {
+            { "exports", g_config.exports },
+            { "callback_latency_ms", g_config.callback_latency_ms },
+            { "latency_ms", g_config.latency_ms },
+            { "region_size", g_config.region_size }
+        };
+    }
+
+    report[ "levels" ] = nlohmann::json::array( );
+    for ( auto connection_count : g_config.connections )
+        report[ "levels" ].push_back( run_level( connection_count, pe, map ) );
+
+    printf( "%s\n", report.dump( 2 ).c_str( ) );
+    return 0;
+}
@@ -0,0 +1,720 @@
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <thread>
+#include <condition_variable>
+
+#include "mutator/helpers/ws/server_wss.hpp"
+#include "mutator/helpers/json.hpp"
+
+#include "mutator/import_table.hpp"
+#include "mutator/map_index.hpp"
+
+// local stand-in for the mutator service, speaks the same protocol as pzm322.com/ws/mutator
+// mapper data and images are fake but deterministic: an image mapped through proceed is byte for byte
+// the same as the template of type 8 rebased on the client, so every mapping path can be checked against the others
+//
+// usage: mock_server [--port 8080] [--latency-ms 0] [--callback-latency-ms 0] [--regions 1] [--region-size 65536]
+//                    [--exports 4] [--imports 32] [--threads 1] [--shards 0] [--cert file --key file] [--ktls 0]
+//                    [--resume-window 60] [--drop-every 0] [--metrics /metrics]
+
+struct mock_config_t {
+    unsigned short port = 8080;
+
+    // time spent "mutating" on initialize and "mapping" on proceed
+    size_t latency_ms = 0;
+    // delay before every callback request sent to the client
+    size_t callback_latency_ms = 0;
+
+    size_t regions = 1;
+    size_t region_size = 64 * 1024;
+    size_t exports = 4;
+    size_t imports = 32;
+
+    size_t threads = 1;
+    // SO_REUSEPORT acceptors with one thread each, replaces threads when above 1
+    size_t shards = 0;
+
+    std::string certificate;
+    std::string private_key;
+    // kernel tls for outgoing records, wss only
+    bool kernel_tls = false;
+
+    // seconds a session outlives its connection and can be resumed ( type 9 )
+    size_t resume_window = 60;
+    // drops the connection instead of handling every nth request, for testing reconnects
+    size_t drop_every = 0;
+
+    // http path answered with the transport counters in the prometheus text format, empty for none
+    std::string metrics_path;
+};
+
+mock_config_t g_config;
+
+// every 64th qword of a region holds an absolute address into region ( index % regions ),
+// import slots are the last qwords of the first region
+// ranges the client trimmed from its upload are reserved zero-filled behind the end of the last region
+namespace fake_image {
+
+    constexpr size_t relocation_stride = 64;
+
+    size_t import_offset( size_t index ) {
+        return g_config.region_size - ( index + 1 ) * sizeof( uint64_t );
+    }
+
+    nlohmann::json imports( ) {
+        nlohmann::json imports = nlohmann::json::object( );
+        for ( size_t index = 0; index < g_config.imports; ++index ) {
+            auto module = "module_" + std::to_string( index / 16 ) + ".dll";
+            imports[ module ].push_back( "function_" + std::to_string( index ) );
+        }
+
+        return imports;
+    }
+
+    std::vector< size_t > sizes( size_t trimmed ) {
+        std::vector< size_t > sizes( g_config.regions, g_config.region_size );
+        sizes.back( ) += trimmed;
+        return sizes;
+    }
+
+    nlohmann::json placements( const std::vector< uint32_t >& trimmed ) {
+        nlohmann::json placements = nlohmann::json::array( );
+
+        auto offset = g_config.region_size;
+        for ( auto size : trimmed ) {
+            placements.push_back( { { "region", g_config.regions - 1 }, { "offset", offset } } );
+            offset += size;
+        }
+
+        return placements;
+    }
+
+    std::vector< std::vector< uint8_t > > regions( size_t trimmed ) {
+        std::vector< std::vector< uint8_t > > regions( g_config.regions );
+        for ( size_t region = 0; region < regions.size( ); ++region ) {
+            auto& image = regions[ region ];
+            image.resize( g_config.region_size );
+
+            for ( size_t offset = 0; offset < image.size( ); ++offset )
+                image[ offset ] = static_cast< uint8_t >( offset * 31 + region * 7 );
+
+            for ( size_t offset = 0; offset + sizeof( uint64_t ) <= import_offset( g_config.imports ); offset += relocation_stride ) {
+                uint64_t value = ( offset * 3 ) % g_config.region_size;
+                memcpy( image.data( ) + offset, &value, sizeof( value ) );
+            }
+        }
+
+        for ( size_t index = 0; index < g_config.imports && !regions.empty( ); ++index )
+            memset( regions[ 0 ].data( ) + import_offset( index ), 0, sizeof( uint64_t ) );
+
+        regions.back( ).resize( g_config.region_size + trimmed );
+        return regions;
+    }
+
+    nlohmann::json relocations( ) {
+        nlohmann::json relocations = nlohmann::json::array( );
+        for ( size_t region = 0; region < g_config.regions; ++region ) {
+            std::map< size_t, std::vector< uint32_t > > targets;
+            for ( size_t offset = 0, index = 0; offset + sizeof( uint64_t ) <= import_offset( g_config.imports ); offset += relocation_stride, ++index )
+                targets[ index % g_config.regions ].push_back( static_cast< uint32_t >( offset ) );
+
+            for ( const auto& target : targets ) {
+                nlohmann::json block;
+                block[ "region" ] = region;
+                block[ "target" ] = target.first;
+                block[ "size" ] = sizeof( uint64_t );
+                block[ "offsets" ] = target.second;
+                relocations.push_back( block );
+            }
+        }
+
+        return relocations;
+    }
+
+    nlohmann::json import_slots( ) {
+        nlohmann::json slots = nlohmann::json::array( );
+
+        size_t index = 0;
+        auto imported = imports( );
+        for ( const auto& imported_module : imported.items( ) ) {
+            for ( const auto& function : imported_module.value( ) ) {
+                nlohmann::json slot;
+                slot[ "module" ] = imported_module.key( );
+                slot[ "function" ] = function;
+                slot[ "region" ] = 0;
+                slot[ "offset" ] = import_offset( index++ );
+                slots.push_back( slot );
+            }
+        }
+
+        return slots;
+    }
+
+    // same as c_image_template::apply on the client
+    bool map( const nlohmann::json& client_info, size_t trimmed, std::vector< std::vector< uint8_t > >& binaries ) {
+        std::vector< uint64_t > bases;
+        std::vector< uint64_t > addresses;
+
+        try {
+            bases = client_info.at( "bases" ).get< std::vector< uint64_t > >( );
+            if ( bases.size( ) < g_config.regions )
+                return false;
+
+            // modules are looked up by name, a client's module order needn't match the one sent
+            pzm::import_table_t import_table;
+            auto indexed = client_info.contains( "import_table" );
+            if ( indexed && !import_table.parse( client_info.at( "import_table" ) ) )
+                return false;
+
+            auto imported = imports( );
+            for ( const auto& imported_module : imported.items( ) ) {
+                size_t position = 0;
+                for ( const auto& function : imported_module.value( ) ) {
+                    if ( !indexed ) {
+                        addresses.push_back( client_info.at( "imports" ).at( imported_module.key( ) ).at( function.get< std::string >( ) ).get< uint64_t >( ) );
+                        continue;
+                    }
+
+                    if ( !import_table.find( imported_module.key( ), position++, addresses.emplace_back( ) ) )
+                        return false;
+                }
+            }
+        } catch ( ... ) {
+            return false;
+        }
+
+        binaries = regions( trimmed );
+        for ( const auto& block : relocations( ) ) {
+            auto& image = binaries[ block.at( "region" ).get< size_t >( ) ];
+            auto base = bases[ block.at( "target" ).get< size_t >( ) ];
+            for ( const auto& offset : block.at( "offsets" ) ) {
+                uint64_t value;
+                memcpy( &value, image.data( ) + offset.get< size_t >( ), sizeof( value ) );
+                value += base;
+                memcpy( image.data( ) + offset.get< size_t >( ), &value, sizeof( value ) );
+            }
+        }
+
+        for ( size_t index = 0; index < addresses.size( ) && !binaries.empty( ); ++index )
+            memcpy( binaries[ 0 ].data( ) + import_offset( index ), &addresses[ index ], sizeof( uint64_t ) );
+
+        return true;
+    }
+
+}
+
+// one mutator session per connection, requests are handled in order on the session's own thread
+// so that callbacks can block on the client's answer just like the real service does
+// a session whose connection dropped is detached and may be attached to the client's next connection
+template< class socket_type >
+class c_mock_session : public std::enable_shared_from_this< c_mock_session< socket_type > > {
+
+    public:
+
+        using connection_t = std::shared_ptr< typename SimpleWeb::SocketServer< socket_type >::Connection >;
+
+        c_mock_session( connection_t connection, std::string session_id )
+            : m_connection( std::move( connection ) ), m_session_id( std::move( session_id ) ) { }
+
+        void start( ) {
+            nlohmann::json hello;
+            hello[ "type" ] = 0;
+            hello[ "session_id" ] = m_session_id;
+            send( hello );
+
+            auto self = this->shared_from_this( );
+            std::thread( [ self ] ( ) { self->run( ); } ).detach( );
+        }
+
+        void stop( ) {
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_closed = true;
+            }
+
+            m_condition.notify_all( );
+        }
+
+        const std::string& id( ) const {
+            return m_session_id;
+        }
+
+        // requests of the lost connection are dropped, a callback waiting for its answer gives up
+        void detach( ) {
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_connection = nullptr;
+                m_inbox.clear( );
+                m_callback_replies.clear( );
+                ++m_epoch;
+            }
+
+            m_condition.notify_all( );
+        }
+
+        void attach( connection_t connection ) {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            m_connection = std::move( connection );
+        }
+
+        void push( nlohmann::json request ) {
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+
+                // callback answers go straight to the request waiting for them
+                if ( request.value( "type", 0 ) == 5 )
+                    m_callback_replies.push_back( std::move( request ) );
+                else
+                    m_inbox.push_back( std::move( request ) );
+            }
+
+            m_condition.notify_all( );
+        }
+
+    private:
+
+        // thrown out of a request whose connection dropped meanwhile
+        struct aborted_t { };
+
+        // anything left of a request whose connection dropped is not sent to the next connection
+        void send( const nlohmann::json& response ) {
+            connection_t connection;
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                if ( m_epoch != m_request_epoch )
+                    throw aborted_t( );
+
+                connection = m_connection;
+            }
+
+            if ( connection )
+                connection->send( response.dump( ) );
+        }
+
+        void send_status( size_t type, int status ) {
+            nlohmann::json response;
+            response[ "type" ] = type;
+            response[ "status" ] = status;
+            send( response );
+        }
+
+        static void sleep( size_t milliseconds ) {
+            if ( milliseconds )
+                std::this_thread::sleep_for( std::chrono::milliseconds( milliseconds ) );
+        }
+
+        void run( ) {
+            while ( true ) {
+                nlohmann::json request;
+                {
+                    std::unique_lock< std::mutex > lock( m_mutex );
+                    m_condition.wait( lock, [ this ] ( ) { return m_closed || !m_inbox.empty( ); } );
+                    if ( m_closed )
+                        return;
+
+                    request = std::move( m_inbox.front( ) );
+                    m_inbox.pop_front( );
+                    m_request_epoch = m_epoch;
+                }
+
+                try {
+                    handle( request );
+                } catch ( const aborted_t& ) {
+                    // the client sends the request again once it's reconnected
+                    continue;
+                } catch ( const std::exception& error ) {
+                    printf( "[%s] invalid request: %s\n", m_session_id.c_str( ), error.what( ) );
+
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    if ( m_connection )
+                        m_connection->send_close( 1011, "invalid request" );
+                    return;
+                }
+            }
+        }
+
+        // sends a callback request, export callbacks wait for the client's value
+        bool callback( int callback_type, const std::string& name = std::string( ) ) {
+            if ( std::find( m_callbacks.begin( ), m_callbacks.end( ), callback_type ) == m_callbacks.end( ) )
+                return true;
+
+            sleep( g_config.callback_latency_ms );
+
+            nlohmann::json request;
+            request[ "type" ] = 5;
+            request[ "callback" ] = callback_type;
+            if ( !name.empty( ) )
+                request[ "name" ] = name;
+
+            send( request );
+
+            // CALLBACK_MMAP_START and CALLBACK_MMAP_END aren't answered
+            if ( callback_type >= 2 )
+                return true;
+
+            std::unique_lock< std::mutex > lock( m_mutex );
+            m_condition.wait( lock, [ this ] ( ) { return m_closed || m_epoch != m_request_epoch || !m_callback_replies.empty( ); } );
+            if ( m_epoch != m_request_epoch )
+                throw aborted_t( );
+            if ( m_closed )
+                return false;
+
+            m_callback_replies.pop_front( );
+            return true;
+        }
+
+        size_t trimmed_size( ) const {
+            size_t size = 0;
+            for ( auto range : m_trimmed )
+                size += range;
+
+            return size;
+        }
+
+        nlohmann::json create_client( ) {
+            nlohmann::json mapper_data;
+            mapper_data[ "client_id" ] = m_next_client++;
+            mapper_data[ "sizes" ] = fake_image::sizes( trimmed_size( ) );
+            mapper_data[ "imports" ] = fake_image::imports( );
+            return mapper_data;
+        }
+
+        nlohmann::json map_client( nlohmann::json client_info ) {
+            callback( 2 );
+            for ( size_t index = 0; index < g_config.exports; ++index )
+                callback( 1, "offset_" + std::to_string( index ) );
+
+            sleep( g_config.latency_ms );
+
+            std::vector< std::vector< uint8_t > > binaries;
+            auto succeeded = m_initialized && fake_image::map( client_info, trimmed_size( ), binaries );
+
+            callback( 3 );
+
+            if ( !client_info.contains( "client_id" ) )
+                client_info[ "client_id" ] = m_next_client++;
+
+            nlohmann::json result;
+            result[ "data" ] = client_info;
+            result[ "succeeded" ] = succeeded;
+            result[ "pe_bin" ] = binaries;
+            if ( !m_trimmed.empty( ) )
+                result[ "trimmed" ] = fake_image::placements( m_trimmed );
+
+            return result;
+        }
+
+        void handle( nlohmann::json& request ) {
+            switch ( request.at( "type" ).get< int >( ) ) {
+                case 0: {
+                    send_status( 1, 0 );
+                    break;
+                }
+                case 1: {
+                    auto pe = request.at( "pe" ).get< std::vector< uint8_t > >( );
+                    const auto& settings = request.at( "settings" );
+                    if ( settings.contains( "callbacks" ) )
+                        m_callbacks = settings.at( "callbacks" ).get< std::vector< int > >( );
+
+                    // STATUS_MISSING_MAP, STATUS_MISSING_BIN, STATUS_INVALID_BIN
+                    pzm::map_index_t map_index;
+                    auto missing_map = request.contains( "map_index" )
+                        ? !map_index.parse( request.at( "map_index" ) ) || map_index.symbols.empty( )
+                        : request.at( "map" ).get< std::string >( ).empty( );
+
+                    if ( missing_map ) {
+                        send_status( 1, 2 );
+                        break;
+                    }
+
+                    if ( pe.empty( ) ) {
+                        send_status( 1, 3 );
+                        break;
+                    }
+
+                    if ( pe.size( ) < 2 || pe[ 0 ] != 'M' || pe[ 1 ] != 'Z' ) {
+                        send_status( 1, 4 );
+                        break;
+                    }
+
+                    m_trimmed.clear( );
+                    if ( request.contains( "trimmed" ) ) {
+                        for ( const auto& range : request.at( "trimmed" ) )
+                            m_trimmed.push_back( range.at( "size" ).get< uint32_t >( ) );
+                    }
+
+                    for ( size_t index = 0; index < g_config.exports; ++index )
+                        callback( 0, "offset_" + std::to_string( index ) );
+
+                    sleep( g_config.latency_ms );
+                    m_initialized = true;
+                    send_status( 1, 0 );
+                    break;
+                }
+                case 2: {
+                    nlohmann::json response;
+                    response[ "type" ] = 3;
+                    response[ "data" ] = create_client( );
+                    send( response );
+                    break;
+                }
+                case 3: {
+                    auto response = map_client( request.at( "data" ) );
+                    response[ "type" ] = 4;
+                    send( response );
+                    break;
+                }
+                case 6: {
+                    auto mapper_data = create_client( );
+
+                    nlohmann::json response;
+                    response[ "type" ] = 3;
+                    response[ "data" ] = mapper_data;
+                    send( response );
+
+                    auto client_info = request.at( "data" );
+                    client_info[ "client_id" ] = mapper_data.at( "client_id" );
+
+                    auto result = map_client( client_info );
+                    result[ "type" ] = 4;
+                    send( result );
+                    break;
+                }
+                case 7: {
+                    nlohmann::json response;
+                    response[ "type" ] = 7;
+                    response[ "results" ] = nlohmann::json::array( );
+                    for ( const auto& client_info : request.at( "data" ) )
+                        response[ "results" ].push_back( map_client( client_info ) );
+
+                    send( response );
+                    break;
+                }
+                case 8: {
+                    nlohmann::json response;
+                    response[ "type" ] = 8;
+                    response[ "succeeded" ] = m_initialized;
+                    response[ "data" ] = create_client( );
+                    response[ "pe_bin" ] = fake_image::regions( trimmed_size( ) );
+                    response[ "relocations" ] = fake_image::relocations( );
+                    response[ "imports" ] = fake_image::import_slots( );
+                    if ( !m_trimmed.empty( ) )
+                        response[ "trimmed" ] = fake_image::placements( m_trimmed );
+                    send( response );
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        connection_t m_connection;
+        std::string m_session_id;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_closed = false;
+        // bumped on every detach, requests remember the epoch they arrived in
+        size_t m_epoch = 0;
+        size_t m_request_epoch = 0;
+
+        std::deque< nlohmann::json > m_inbox;
+        std::deque< nlohmann::json > m_callback_replies;
+
+        std::vector< int > m_callbacks;
+        bool m_initialized = false;
+        // sizes of the ranges the client left out of its upload, in the order of init_request[ "trimmed" ]
+        std::vector< uint32_t > m_trimmed;
+        uint32_t m_next_client = 1;
+
+};
+
+template< class socket_type >
+void run_server( SimpleWeb::SocketServer< socket_type >& server ) {
+    using server_t = SimpleWeb::SocketServer< socket_type >;
+    using session_t = c_mock_session< socket_type >;
+
+    std::mutex sessions_mutex;
+    std::map< typename server_t::Connection*, std::shared_ptr< session_t > > sessions;
+    size_t next_session = 1;
+
+    // sessions without a connection by id, together with the time they were detached
+    std::map< std::string, std::pair< std::shared_ptr< session_t >, std::chrono::steady_clock::time_point > > detached;
+    std::atomic< size_t > requests = 0;
+
+    // sessions_mutex must be locked here
+    auto expire_detached = [ & ] ( ) {
+        auto now = std::chrono::steady_clock::now( );
+        for ( auto entry = detached.begin( ); entry != detached.end( ); ) {
+            if ( now - entry->second.second < std::chrono::seconds( g_config.resume_window ) ) {
+                ++entry;
+                continue;
+            }
+
+            entry->second.first->stop( );
+            entry = detached.erase( entry );
+        }
+    };
+
+    auto close_session = [ & ] ( const std::shared_ptr< typename server_t::Connection >& connection ) {
+        std::lock_guard< std::mutex > lock( sessions_mutex );
+        expire_detached( );
+
+        auto session = sessions.find( connection.get( ) );
+        if ( session == sessions.end( ) )
+            return;
+
+        session->second->detach( );
+        detached[ session->second->id( ) ] = { session->second, std::chrono::steady_clock::now( ) };
+        sessions.erase( session );
+    };
+
+    // answers type 9, the session is reattached if it's still around, otherwise the connection keeps its fresh one
+    auto resume_session = [ & ] ( const std::shared_ptr< typename server_t::Connection >& connection, const nlohmann::json& request ) {
+        nlohmann::json response;
+        response[ "type" ] = 9;
+        response[ "status" ] = 0;
+        response[ "resumed" ] = false;
+        {
+            std::lock_guard< std::mutex > lock( sessions_mutex );
+            expire_detached( );
+
+            auto current = sessions.find( connection.get( ) );
+            if ( current == sessions.end( ) )
+                return;
+
+            auto previous = detached.find( request.value( "session_id", std::string( ) ) );
+            if ( previous != detached.end( ) ) {
+                current->second->stop( );
+                current->second = previous->second.first;
+                current->second->attach( connection );
+                detached.erase( previous );
+
+                response[ "resumed" ] = true;
+            }
+
+            response[ "session_id" ] = current->second->id( );
+        }
+
+        connection->send( response.dump( ) );
+    };
+
+    server.config.port = g_config.port;
+    server.config.thread_pool_size = g_config.threads;
+    server.config.acceptor_shards = g_config.shards;
+    server.config.kernel_tls = g_config.kernel_tls;
+    server.config.metrics_path = g_config.metrics_path;
+
+    auto& endpoint = server.endpoint[ "^/ws/mutator/?$" ];
+    endpoint.on_open = [ & ] ( std::shared_ptr< typename server_t::Connection > connection ) {
+        std::shared_ptr< session_t > session;
+        {
+            std::lock_guard< std::mutex > lock( sessions_mutex );
+            session = std::make_shared< session_t >( connection, "mock-" + std::to_string( next_session++ ) );
+            sessions[ connection.get( ) ] = session;
+        }
+
+        session->start( );
+    };
+
+    endpoint.on_message = [ & ] ( std::shared_ptr< typename server_t::Connection > connection,
+        std::shared_ptr< typename server_t::InMessage > message ) {
+        nlohmann::json request;
+        try {
+            request = nlohmann::json::parse( message->string( ) );
+        } catch ( ... ) {
+            return;
+        }
+
+        std::shared_ptr< session_t > session;
+        {
+            std::lock_guard< std::mutex > lock( sessions_mutex );
+            auto entry = sessions.find( connection.get( ) );
+            if ( entry != sessions.end( ) )
+                session = entry->second;
+        }
+
+        if ( !request.is_object( ) )
+            return;
+
+        if ( g_config.drop_every && ++requests % g_config.drop_every == 0 ) {
+            printf( "dropping connection\n" );
+            connection->close( );
+            return;
+        }
+
+        if ( request.value( "type", 0 ) == 9 )
+            resume_session( connection, request );
+        else if ( session )
+            session->push( std::move( request ) );
+    };
+
+    endpoint.on_close = [ & ] ( std::shared_ptr< typename server_t::Connection > connection, int, const std::string& ) {
+        close_session( connection );
+    };
+
+    endpoint.on_error = [ & ] ( std::shared_ptr< typename server_t::Connection > connection, const SimpleWeb::error_code& ) {
+        close_session( connection );
+    };
+
+    server.start( [ ] ( unsigned short port ) {
+        printf( "mock mutator listening on port %hu\n", port );
+    } );
+}
+
+int main( int argc, char** argv ) {
+    for ( int index = 1; index + 1 < argc; index += 2 ) {
+        std::string option = argv[ index ];
+        std::string value = argv[ index + 1 ];
+
+        if ( option == "--port" )
+            g_config.port = static_cast< unsigned short >( std::stoul( value ) );
+        else if ( option == "--latency-ms" )
+            g_config.latency_ms = std::stoul( value );
+        else if ( option == "--callback-latency-ms" )
+            g_config.callback_latency_ms = std::stoul( value );
+        else if ( option == "--regions" )
+            g_config.regions = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--region-size" )
+            g_config.region_size = std::max< size_t >( std::stoul( value ), 4096 );
+        else if ( option == "--exports" )
+            g_config.exports = std::stoul( value );
+        else if ( option == "--imports" )
+            g_config.imports = std::stoul( value );
+        else if ( option == "--threads" )
+            g_config.threads = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--shards" )
+            g_config.shards = std::stoul( value );
+        else if ( option == "--cert" )
+            g_config.certificate = value;
+        else if ( option == "--key" )
+            g_config.private_key = value;
+        else if ( option == "--ktls" )
+            g_config.kernel_tls = value != "0";
+        else if ( option == "--resume-window" )
+            g_config.resume_window = std::stoul( value );
+        else if ( option == "--drop-every" )
+            g_config.drop_every = std::stoul( value );
+        else if ( option == "--metrics" )
+            g_config.metrics_path = value;
+        else {
+            printf( "unknown option %s\n", option.c_str( ) );
+            return 1;
+        }
+    }
+
+    // import slots must fit in the first region
+    g_config.imports = std::min( g_config.imports, g_config.region_size / sizeof( uint64_t ) / 2 );
+
+    if ( !g_config.certificate.empty( ) ) {
+        SimpleWeb::SocketServer< SimpleWeb::WSS > server( g_config.certificate, g_config.private_key );
+        run_server( server );
+    } else {
+        SimpleWeb::SocketServer< SimpleWeb::WS > server;
+        run_server( server );
+    }
+
+    return 0;
+}
@@ -0,0 +1,518 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mutator/inst.hpp"
+#include "synthetic_pe.hpp"
+
+// micro-benchmarks of the sdk hot paths, the results are written as json so runs of different sdk versions can be compared
+//
+// every benchmark is run in samples of a calibrated number of iterations until min-time is spent,
+// ns_per_op is the median over the samples, mb_per_s is derived from it and the bytes handled per operation
+// client_send_mask and server_receive_unmask run over a loopback websocket held in this process
+// numbers are only comparable between builds of the same type, configure with -DCMAKE_BUILD_TYPE=Release for them
+//
+// usage: mutator_bench [--pe-size 4194304] [--map-size 1048576] [--message-size 1048576] [--min-time-ms 500]
+//                      [--filter name] [--label text] [--output file]
+
+struct bench_config_t {
+    size_t pe_size = 4 * 1024 * 1024;
+    size_t map_size = 1024 * 1024;
+    size_t message_size = 1024 * 1024;
+    std::chrono::milliseconds min_time = std::chrono::milliseconds( 500 );
+
+    // only benchmarks whose name contains filter run
+    std::string filter;
+    // stored with the results, e.g. the sdk version or commit under test
+    std::string label;
+    std::string output;
+};
+
+bench_config_t g_config;
+
+using bench_clock_t = std::chrono::steady_clock;
+
+class c_bench_runner {
+
+    public:
+
+        // body runs one operation and returns a value that depends on its work, which keeps it from being optimized out
+        void run( const std::string& name, size_t bytes_per_op, const std::function< size_t ( ) >& body,
+            const std::function< void ( ) >& after_sample = nullptr ) {
+            if ( !g_config.filter.empty( ) && name.find( g_config.filter ) == std::string::npos )
+                return;
+
+            fprintf( stderr, "%s ...\n", name.c_str( ) );
+
+            // warm up and pick a sample size of at least a millisecond
+            size_t batch = 1;
+            while ( true ) {
+                auto elapsed = sample( batch, body, after_sample );
+                if ( elapsed >= std::chrono::milliseconds( 1 ) || batch >= ( 1u << 24 ) )
+                    break;
+
+                batch *= 2;
+            }
+
+            std::vector< double > samples;
+            bench_clock_t::duration total { };
+            while ( total < g_config.min_time || samples.size( ) < 5 ) {
+                auto elapsed = sample( batch, body, after_sample );
+                total += elapsed;
+                samples.push_back( std::chrono::duration< double, std::nano >( elapsed ).count( ) / static_cast< double >( batch ) );
+            }
+
+            std::sort( samples.begin( ), samples.end( ) );
+            auto median = samples[ samples.size( ) / 2 ];
+
+            double mean = 0.0;
+            for ( auto value : samples )
+                mean += value;
+            mean /= static_cast< double >( samples.size( ) );
+
+            nlohmann::json result;
+            result[ "name" ] = name;
+            result[ "iterations" ] = batch * samples.size( );
+            result[ "samples" ] = samples.size( );
+            result[ "bytes_per_op" ] = bytes_per_op;
+            result[ "ns_per_op" ] = median;
+            result[ "ns_per_op_min" ] = samples.front( );
+            result[ "ns_per_op_mean" ] = mean;
+            result[ "ns_per_op_max" ] = samples.back( );
+            result[ "mb_per_s" ] = bytes_per_op ? static_cast< double >( bytes_per_op ) / median * 1000.0 : 0.0;
+            m_results.push_back( std::move( result ) );
+        }
+
+        nlohmann::json results( ) const {
+            return m_results;
+        }
+
+    private:
+
+        bench_clock_t::duration sample( size_t batch, const std::function< size_t ( ) >& body,
+            const std::function< void ( ) >& after_sample ) {
+            size_t sink = 0;
+            auto start = bench_clock_t::now( );
+            for ( size_t index = 0; index < batch; ++index )
+                sink += body( );
+
+            auto elapsed = bench_clock_t::now( ) - start;
+            m_sink.fetch_add( sink, std::memory_order_relaxed );
+
+            // work outside the measured time, like draining what the sample queued
+            if ( after_sample )
+                after_sample( );
+
+            return elapsed;
+        }
+
+        nlohmann::json m_results = nlohmann::json::array( );
+        std::atomic< size_t > m_sink = 0;
+
+};
+
+std::mt19937 g_generator( 322 );
+
+std::vector< uint8_t > random_bytes( size_t size ) {
+    std::vector< uint8_t > bytes( size );
+    for ( auto& byte : bytes )
+        byte = static_cast< uint8_t >( g_generator( ) );
+
+    return bytes;
+}
+
+// text shaped like an msvc map file
+std::string map_text( size_t size ) {
+    std::string text = " Preferred load address is 0000000180000000\n\n"
+        "  Address         Publics by Value              Rva+Base               Lib:Object\n\n";
+
+    for ( size_t index = 0; text.size( ) < size; ++index ) {
+        char line[ 160 ];
+        snprintf( line, sizeof( line ), " 0001:%08zx       ?function_%zu@@YAXXZ       %016zx f   object_%zu.obj\n",
+            index * 16, index, 0x180001000 + index * 16, index % 64 );
+        text += line;
+    }
+
+    text.resize( size );
+    return text;
+}
+
+// the init request as c_mutator::upload builds it, with the default settings and no callbacks
+nlohmann::json make_init_request( const std::vector< uint8_t >& pe, const std::string& map ) {
+    nlohmann::json init_request;
+    init_request[ "type" ] = 1;
+    init_request[ "map" ] = map;
+    init_request[ "pe" ] = pe;
+
+    nlohmann::json settings;
+    settings[ "shuffle" ] = false;
+    settings[ "partition" ] = false;
+    settings[ "verify_partition" ] = false;
+    init_request[ "settings" ] = settings;
+
+    return init_request;
+}
+
+void bench_init_request( c_bench_runner& runner ) {
+    auto pe = random_bytes( g_config.pe_size );
+    auto map = map_text( g_config.map_size );
+
+    runner.run( "init_request_build", pe.size( ) + map.size( ), [ & ] ( ) {
+        return make_init_request( pe, map ).size( );
+    } );
+
+    auto request = make_init_request( pe, map );
+    runner.run( "init_request_dump", pe.size( ) + map.size( ), [ & ] ( ) {
+        return request.dump( ).size( );
+    } );
+}
+
+// a mapping result ( type 4 ) carrying one image of pe_size bytes
+void bench_on_message( c_bench_runner& runner ) {
+    nlohmann::json response;
+    response[ "type" ] = 4;
+    response[ "succeeded" ] = true;
+    response[ "data" ] = { { "client_id", 1 }, { "base", 0x180000000ull } };
+    response[ "pe_bin" ] = std::vector< std::vector< uint8_t > > { random_bytes( g_config.pe_size ) };
+
+    auto message = response.dump( );
+
+    // never started, on_message only queues the packet, which is taken again right away
+    pzm::c_connection owner;
+    runner.run( "on_message_parse", message.size( ), [ & ] ( ) {
+        pzm::ws_callbacks::on_message( owner, message );
+        return owner.wait_packet( 4, 1 ).size( );
+    } );
+}
+
+void bench_handshake_crypto( c_bench_runner& runner ) {
+    auto nonce = random_bytes( 16 );
+    std::string nonce_string( nonce.begin( ), nonce.end( ) );
+    auto key = SimpleWeb::Crypto::Base64::encode( nonce_string );
+
+    runner.run( "base64_encode_nonce", nonce_string.size( ), [ & ] ( ) {
+        return SimpleWeb::Crypto::Base64::encode( nonce_string ).size( );
+    } );
+
+    runner.run( "base64_decode_key", key.size( ), [ & ] ( ) {
+        return SimpleWeb::Crypto::Base64::decode( key ).size( );
+    } );
+
+    runner.run( "sha1_accept_input", key.size( ) + 36, [ & ] ( ) {
+        return SimpleWeb::Crypto::sha1( key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" ).size( );
+    } );
+
+    runner.run( "websocket_accept", key.size( ), [ & ] ( ) {
+        return SimpleWeb::Crypto::websocket_accept( key ).size( );
+    } );
+}
+
+// a server on a loopback port that counts the messages it receives
+class c_loopback_server {
+
+    public:
+
+        c_loopback_server( ) {
+            m_server.config.address = "127.0.0.1";
+            m_server.config.port = 0;
+
+            auto& endpoint = m_server.endpoint[ "^/bench/?$" ];
+            endpoint.on_message = [ this ] ( std::shared_ptr< server_t::Connection >, std::shared_ptr< server_t::InMessage > message ) {
+                {
+                    std::lock_guard< std::mutex > lock( m_mutex );
+                    ++m_received;
+                    m_received_bytes += message->size( );
+                }
+
+                m_condition.notify_all( );
+            };
+
+            std::promise< unsigned short > port;
+            auto started = port.get_future( );
+            m_thread = std::thread( [ this, &port ] ( ) {
+                m_server.start( [ &port ] ( unsigned short assigned ) { port.set_value( assigned ); } );
+            } );
+
+            m_port = started.get( );
+        }
+
+        ~c_loopback_server( ) {
+            m_server.stop( );
+            m_thread.join( );
+        }
+
+        unsigned short port( ) const {
+            return m_port;
+        }
+
+        size_t received( ) {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            return m_received;
+        }
+
+        void wait_received( size_t count ) {
+            std::unique_lock< std::mutex > lock( m_mutex );
+            m_condition.wait( lock, [ & ] ( ) { return m_received >= count; } );
+        }
+
+    private:
+
+        using server_t = SimpleWeb::SocketServer< SimpleWeb::WS >;
+
+        server_t m_server;
+        std::thread m_thread;
+        unsigned short m_port = 0;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        size_t m_received = 0;
+        size_t m_received_bytes = 0;
+
+};
+
+// time spent in Connection::send, which masks the message on the calling thread before queueing it
+void bench_client_send( c_bench_runner& runner, c_loopback_server& server ) {
+    using client_t = SimpleWeb::SocketClient< SimpleWeb::WS >;
+
+    client_t client( "127.0.0.1:" + std::to_string( server.port( ) ) + "/bench" );
+
+    std::promise< std::shared_ptr< client_t::Connection > > opened;
+    auto connection_future = opened.get_future( );
+    client.on_open = [ &opened ] ( std::shared_ptr< client_t::Connection > connection ) {
+        opened.set_value( std::move( connection ) );
+    };
+
+    std::thread thread( [ &client ] ( ) { client.start( ); } );
+    auto connection = connection_future.get( );
+
+    auto payload = random_bytes( g_config.message_size );
+    std::string message( payload.begin( ), payload.end( ) );
+
+    auto sent = server.received( );
+    runner.run( "client_send_mask", message.size( ), [ & ] ( ) {
+        connection->send( message, nullptr, 130 );
+        ++sent;
+        return message.size( );
+    }, [ & ] ( ) {
+        server.wait_received( sent );
+    } );
+
+    client.stop( );
+    thread.join( );
+}
+
+// masked frames written to the server as they are, the time until it handed them to on_message
+void bench_server_receive( c_bench_runner& runner, c_loopback_server& server ) {
+    SimpleWeb::io_context context;
+    SimpleWeb::asio::ip::tcp::socket socket( context );
+    socket.connect( SimpleWeb::asio::ip::tcp::endpoint( SimpleWeb::make_address( "127.0.0.1" ), server.port( ) ) );
+    socket.set_option( SimpleWeb::asio::ip::tcp::no_delay( true ) );
+
+    std::string upgrade = "GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    SimpleWeb::asio::write( socket, SimpleWeb::asio::buffer( upgrade ) );
+
+    SimpleWeb::asio::streambuf response;
+    SimpleWeb::asio::read_until( socket, response, "\r\n\r\n" );
+
+    auto payload = random_bytes( g_config.message_size );
+    std::vector< uint8_t > frame = { 130, 127 | 128 };
+    for ( size_t shift = 64; shift > 0; shift -= 8 )
+        frame.push_back( static_cast< uint8_t >( static_cast< uint64_t >( payload.size( ) ) >> ( shift - 8 ) ) );
+
+    std::array< uint8_t, 4 > mask = { 0x12, 0x34, 0x56, 0x78 };
+    frame.insert( frame.end( ), mask.begin( ), mask.end( ) );
+    for ( size_t index = 0; index < payload.size( ); ++index )
+        frame.push_back( payload[ index ] ^ mask[ index % 4 ] );
+
+    auto received = server.received( );
+    runner.run( "server_receive_unmask", payload.size( ), [ & ] ( ) {
+        SimpleWeb::asio::write( socket, SimpleWeb::asio::buffer( frame ) );
+        server.wait_received( ++received );
+        return payload.size( );
+    } );
+
+    SimpleWeb::error_code ec;
+    socket.close( ec );
+}
+
+void bench_parse_pe( c_bench_runner& runner ) {
+    auto pe = synthetic_pe::make( g_config.pe_size );
+
+    runner.run( "parse_pe", 0, [ & ] ( ) {
+        pzm::pe_image_t image;
+        return static_cast< size_t >( pzm::parse_pe( pe, image ) ) + image.sections.size( );
+    } );
+
+    // half of the image is resources, trim_pe copies the other half
+    auto resources = synthetic_pe::make( g_config.pe_size / 2, 322, g_config.pe_size / 2 );
+    pzm::pe_image_t image;
+    pzm::parse_pe( resources, image );
+
+    runner.run( "trim_pe", resources.size( ), [ & ] ( ) {
+        pzm::pe_trim_t trim;
+        pzm::trim_pe( resources, image, trim );
+        return trim.binary.size( );
+    } );
+}
+
+void bench_map_index( c_bench_runner& runner ) {
+    auto map = map_text( g_config.map_size );
+    auto pe = synthetic_pe::make( g_config.pe_size );
+
+    pzm::map_index_t index;
+    pzm::parse_map( map, index );
+
+    pzm::pe_image_t image;
+    pzm::parse_pe( pe, image );
+
+    runner.run( "parse_map", map.size( ), [ & ] ( ) {
+        pzm::map_index_t parsed;
+        pzm::parse_map( map, parsed );
+        return parsed.symbols.size( );
+    } );
+
+    runner.run( "map_index_dump", map.size( ), [ & ] ( ) {
+        return index.relevant( image ).to_json( ).dump( ).size( );
+    } );
+
+    std::mt19937 generator( 322 );
+    runner.run( "map_index_find", 0, [ & ] ( ) {
+        auto rva = static_cast< uint32_t >( 0x1000 + generator( ) % ( index.symbols.size( ) * 16 ) );
+        auto symbol = index.find( rva );
+        return symbol ? index.find( index.name( *symbol ) )->rva : 0;
+    } );
+}
+
+void bench_set_directory( c_bench_runner& runner ) {
+    auto directory = std::filesystem::temp_directory_path( ) / ( "mutator_bench_" + std::to_string( getpid( ) ) );
+    std::filesystem::create_directories( directory );
+
+    {
+        auto pe = synthetic_pe::make( g_config.pe_size );
+        std::ofstream( directory / "module.dll", std::ios::binary ).write( reinterpret_cast< const char* >( pe.data( ) ),
+            static_cast< std::streamsize >( pe.size( ) ) );
+        std::ofstream( directory / "module.map" ) << map_text( g_config.map_size );
+    }
+
+    runner.run( "set_directory_load", g_config.pe_size + g_config.map_size, [ & ] ( ) {
+        pzm::c_mutator mutator( nullptr );
+        mutator.set_directory( directory.string( ) );
+        return g_config.pe_size;
+    } );
+
+    // the same amount of data split over several modules, read one at a time and then on every hardware thread
+    constexpr size_t module_count = 4;
+    auto modules = directory / "modules";
+    std::filesystem::create_directories( modules );
+
+    for ( size_t index = 0; index < module_count; ++index ) {
+        auto name = "module_" + std::to_string( index );
+        auto pe = synthetic_pe::make( g_config.pe_size / module_count, static_cast< uint32_t >( 322 + index ) );
+        std::ofstream( modules / ( name + ".dll" ), std::ios::binary ).write( reinterpret_cast< const char* >( pe.data( ) ),
+            static_cast< std::streamsize >( pe.size( ) ) );
+        std::ofstream( modules / ( name + ".map" ) ) << map_text( g_config.map_size / module_count );
+    }
+
+    runner.run( "set_directory_modules_serial", g_config.pe_size + g_config.map_size, [ & ] ( ) {
+        pzm::c_mutator mutator( nullptr );
+        mutator.set_directory( modules.string( ), 1 );
+        return mutator.modules( ).size( );
+    } );
+
+    runner.run( "set_directory_modules", g_config.pe_size + g_config.map_size, [ & ] ( ) {
+        pzm::c_mutator mutator( nullptr );
+        mutator.set_directory( modules.string( ) );
+        return mutator.modules( ).size( );
+    } );
+
+    std::error_code ec;
+    std::filesystem::remove_all( directory, ec );
+}
+
+std::string timestamp( ) {
+    auto now = std::time( nullptr );
+    char buffer[ 32 ] = { };
+    std::strftime( buffer, sizeof( buffer ), "%Y-%m-%dT%H:%M:%SZ", std::gmtime( &now ) );
+    return buffer;
+}
+
+int main( int argc, char** argv ) {
+    for ( int index = 1; index + 1 < argc; index += 2 ) {
+        std::string option = argv[ index ];
+        std::string value = argv[ index + 1 ];
+
+        if ( option == "--pe-size" )
+            g_config.pe_size = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--map-size" )
+            g_config.map_size = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--message-size" )
+            g_config.message_size = std::max< size_t >( std::stoul( value ), 1 );
+        else if ( option == "--min-time-ms" )
+            g_config.min_time = std::chrono::milliseconds( std::stoul( value ) );
+        else if ( option == "--filter" )
+            g_config.filter = value;
+        else if ( option == "--label" )
+            g_config.label = value;
+        else if ( option == "--output" )
+            g_config.output = value;
+        else {
+            printf( "unknown option %s\n", option.c_str( ) );
+            return 1;
+        }
+    }
+
+    c_bench_runner runner;
+    bench_init_request( runner );
+    bench_on_message( runner );
+    bench_handshake_crypto( runner );
+
+    {
+        c_loopback_server server;
+        bench_client_send( runner, server );
+        bench_server_receive( runner, server );
+    }
+
+    bench_parse_pe( runner );
+    bench_map_index( runner );
+    bench_set_directory( runner );
+
+    nlohmann::json report;
+    report[ "label" ] = g_config.label;
+    report[ "timestamp" ] = timestamp( );
+#ifdef MUTATOR_BENCH_BUILD_TYPE
+    report[ "build_type" ] = MUTATOR_BENCH_BUILD_TYPE;
+#endif
+#ifdef __VERSION__
+    report[ "compiler" ] = __VERSION__;
+#endif
+    report[ "config" ] = {
+        { "pe_size", g_config.pe_size },
+        { "map_size", g_config.map_size },
+        { "message_size", g_config.message_size },
+        { "min_time_ms", g_config.min_time.count( ) }
+    };
+    report[ "results" ] = runner.results( );
+
+    auto text = report.dump( 2 );
+    if ( g_config.output.empty( ) )
+        printf( "%s\n", text.c_str( ) );
+    else
+        std::ofstream( g_config.output ) << text << "\n";
+
+    return 0;
+}
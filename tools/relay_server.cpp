@@ -0,0 +1,270 @@
+#include "mutator/session_pool.hpp"
+
+// reference relay between end users and the mutator
+// end users connect to wss://host:port/relay and send their client layout as json
+// ( same as client_info for proceed, without "client_id" ), the relay queues the job, maps a freshly
+// mutated image on one of the upstream sessions and streams it back: a json header followed by one binary frame per region
+
+using ws_server_t = SimpleWeb::SocketServer< SimpleWeb::WSS >;
+using ws_connection_t = std::shared_ptr< ws_server_t::Connection >;
+
+struct relay_config_t {
+    std::string certificate;
+    std::string private_key;
+    std::string directory;
+
+    unsigned short port = 8443;
+
+    // jobs waiting for an upstream session, further requests are rejected until the queue drains
+    size_t max_queue = 256;
+    // number of jobs mapped concurrently
+    size_t workers = 4;
+    // acceptors sharing the port, each on its own core with its own io_context
+    size_t shards = 0;
+    // end-user requests only carry a client layout
+    size_t max_message_size = 1 << 20;
+    // mapped images are sent with kernel tls where available, this turns off session tickets for end users
+    bool kernel_tls = false;
+};
+
+class c_relay {
+
+    public:
+
+        explicit c_relay( relay_config_t config ) : m_config( std::move( config ) ),
+            m_server( m_config.certificate, m_config.private_key ) {
+            pzm::pool_config_t pool_config;
+            pool_config.low_watermark = m_config.workers;
+            pool_config.high_watermark = m_config.workers * 2;
+            pool_config.workers = m_config.workers;
+
+            auto directory = m_config.directory;
+            m_pool = std::make_unique< pzm::c_session_pool >( [ directory ] ( pzm::c_mutator& session ) {
+                session.set_directory( directory );
+            }, pool_config );
+        }
+
+        void run( ) {
+            m_server.config.port = m_config.port;
+            m_server.config.max_message_size = m_config.max_message_size;
+            m_server.config.timeout_idle = 300;
+            m_server.config.acceptor_shards = m_config.shards;
+            m_server.config.kernel_tls = m_config.kernel_tls;
+
+            auto& endpoint = m_server.endpoint[ "^/relay/?$" ];
+            endpoint.on_message = [ this ] ( ws_connection_t connection, std::shared_ptr< ws_server_t::InMessage > message ) {
+                on_message( std::move( connection ), message->string( ) );
+            };
+            endpoint.on_close = [ this ] ( ws_connection_t connection, int, const std::string& ) {
+                forget( connection );
+            };
+            endpoint.on_error = [ this ] ( ws_connection_t connection, const SimpleWeb::error_code& ) {
+                forget( connection );
+            };
+
+            m_pool->start( );
+
+            m_running = true;
+            for ( size_t index = 0; index < m_config.workers; ++index )
+                m_workers.emplace_back( [ this ] ( ) { worker( ); } );
+
+            m_server.start( [ ] ( unsigned short port ) {
+                printf( "relay listening on port %hu\n", port );
+            } );
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_running = false;
+            }
+
+            m_condition.notify_all( );
+            for ( auto& worker : m_workers )
+                worker.join( );
+
+            m_pool->stop( );
+        }
+
+    private:
+
+        struct job_t {
+            ws_connection_t connection;
+            nlohmann::json client_info;
+            uint64_t id = 0;
+        };
+
+        static void send_error( const ws_connection_t& connection, const std::string& error ) {
+            nlohmann::json response;
+            response[ "succeeded" ] = false;
+            response[ "error" ] = error;
+            connection->send( response.dump( ) );
+        }
+
+        void on_message( ws_connection_t connection, const std::string& message ) {
+            nlohmann::json client_info;
+            try {
+                client_info = nlohmann::json::parse( message );
+            } catch ( ... ) {
+                send_error( connection, "invalid request" );
+                return;
+            }
+
+            if ( !client_info.is_object( ) || !client_info.contains( "bases" ) ) {
+                send_error( connection, "invalid request" );
+                return;
+            }
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+
+                // one job per end user at a time, a user can't queue more work than it reads back
+                if ( m_active.count( connection.get( ) ) ) {
+                    send_error( connection, "job already in progress" );
+                    return;
+                }
+
+                if ( m_jobs.size( ) >= m_config.max_queue ) {
+                    send_error( connection, "busy" );
+                    return;
+                }
+
+                auto id = ++m_last_job;
+                m_active.emplace( connection.get( ), id );
+                m_jobs.push_back( { std::move( connection ), std::move( client_info ), id } );
+            }
+
+            m_condition.notify_one( );
+        }
+
+        void forget( const ws_connection_t& connection ) {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            m_active.erase( connection.get( ) );
+
+            // jobs of users that are already gone are never mapped
+            m_jobs.erase( std::remove_if( m_jobs.begin( ), m_jobs.end( ), [ & ] ( const job_t& job ) {
+                return job.connection == connection;
+            } ), m_jobs.end( ) );
+        }
+
+        void worker( ) {
+            while ( true ) {
+                job_t job;
+                {
+                    std::unique_lock< std::mutex > lock( m_mutex );
+                    m_condition.wait( lock, [ this ] ( ) { return !m_running || !m_jobs.empty( ); } );
+                    if ( !m_running )
+                        return;
+
+                    job = std::move( m_jobs.front( ) );
+                    m_jobs.pop_front( );
+                }
+
+                process( job );
+            }
+        }
+
+        // the connection may be gone and its address reused by the time a job's last send completes,
+        // so the slot is only freed while it still belongs to that job
+        void release( ws_server_t::Connection* connection, uint64_t id ) {
+            std::lock_guard< std::mutex > lock( m_mutex );
+
+            auto it = m_active.find( connection );
+            if ( it != m_active.end( ) && it->second == id )
+                m_active.erase( it );
+        }
+
+        void process( job_t& job ) {
+            auto session = m_pool->acquire( std::chrono::seconds( 30 ) );
+            if ( !session ) {
+                send_error( job.connection, "no upstream session available" );
+                release( job.connection.get( ), job.id );
+                return;
+            }
+
+            nlohmann::json mapper_data;
+            std::vector< std::vector< uint8_t > > binaries;
+
+            auto succeeded = session->map( job.client_info, mapper_data, binaries );
+
+            nlohmann::json header;
+            header[ "succeeded" ] = succeeded;
+            header[ "data" ] = job.client_info;
+            header[ "mapper_data" ] = mapper_data;
+            header[ "regions" ] = succeeded ? binaries.size( ) : 0;
+
+            // the user may only send its next request once the whole image left the send queue,
+            // so a slow reader can't pile up mapped images in memory
+            auto connection = job.connection.get( );
+            std::function< void ( const SimpleWeb::error_code& ) > on_sent = [ this, connection, id = job.id ] ( const SimpleWeb::error_code& ) {
+                release( connection, id );
+            };
+
+            if ( !succeeded ) {
+                job.connection->send( header.dump( ), on_sent );
+                return;
+            }
+
+            job.connection->send( header.dump( ), binaries.empty( ) ? on_sent : nullptr );
+            for ( size_t index = 0; index < binaries.size( ); ++index ) {
+                const auto& binary = binaries[ index ];
+
+                auto out_message = std::make_shared< ws_server_t::OutMessage >( binary.size( ) );
+                out_message->write( reinterpret_cast< const char* >( binary.data( ) ), static_cast< std::streamsize >( binary.size( ) ) );
+
+                // fin_rsv_opcode=130: one fragment, binary
+                job.connection->send( out_message, index + 1 == binaries.size( ) ? on_sent : nullptr, 130 );
+            }
+        }
+
+        relay_config_t m_config;
+        ws_server_t m_server;
+        std::unique_ptr< pzm::c_session_pool > m_pool;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_running = false;
+
+        std::deque< job_t > m_jobs;
+        // connections with a job queued or running, and the id of that job
+        std::unordered_map< ws_server_t::Connection*, uint64_t > m_active;
+        uint64_t m_last_job = 0;
+        std::vector< std::thread > m_workers;
+
+};
+
+int main( int argc, char** argv ) {
+    if ( argc < 4 ) {
+        printf( "usage: %s <certificate> <private key> <image directory> [port] [workers] [max queue] [shards]\n", argv[ 0 ] );
+        printf( "credentials are read from PZM_USERNAME and PZM_PASSWORD, set PZM_KTLS=1 for kernel tls\n" );
+        return 1;
+    }
+
+    relay_config_t config;
+    config.certificate = argv[ 1 ];
+    config.private_key = argv[ 2 ];
+    config.directory = argv[ 3 ];
+
+    if ( argc > 4 )
+        config.port = static_cast< unsigned short >( std::stoul( argv[ 4 ] ) );
+
+    if ( argc > 5 )
+        config.workers = std::max< size_t >( std::stoul( argv[ 5 ] ), 1 );
+
+    if ( argc > 6 )
+        config.max_queue = std::stoul( argv[ 6 ] );
+
+    if ( argc > 7 )
+        config.shards = std::stoul( argv[ 7 ] );
+
+    if ( auto user = std::getenv( "PZM_USERNAME" ) )
+        pzm::username = user;
+
+    if ( auto pass = std::getenv( "PZM_PASSWORD" ) )
+        pzm::password = pass;
+
+    if ( auto ktls = std::getenv( "PZM_KTLS" ) )
+        config.kernel_tls = std::string( ktls ) != "0";
+
+    c_relay relay( config );
+    relay.run( );
+    return 0;
+}
@@ -0,0 +1,121 @@
+#ifndef PZM_SYNTHETIC_PE_HPP
+#define PZM_SYNTHETIC_PE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// well-formed x64 dll images of a given size for the tools that drive the sdk without real binaries:
+// dos and nt headers and a code section holding random bytes, optionally followed by a resource section
+// ( with a codeview debug entry at the start of the code ) and an overlay registered as certificate table
+namespace synthetic_pe {
+
+    constexpr uint32_t file_alignment = 0x200;
+    constexpr uint32_t section_alignment = 0x1000;
+    constexpr uint32_t headers_size = 0x400;
+
+    template< class T >
+    void put( std::vector< uint8_t >& image, size_t offset, T value ) {
+        std::memcpy( image.data( ) + offset, &value, sizeof( T ) );
+    }
+
+    inline uint32_t align( uint32_t value, uint32_t alignment ) {
+        return ( value + alignment - 1 ) / alignment * alignment;
+    }
+
+    // size is rounded up to the file alignment, with at least one aligned block of code,
+    // resources and overlay come on top of it
+    inline std::vector< uint8_t > make( size_t size, uint32_t seed = 322, size_t resource_size = 0, size_t overlay_size = 0 ) {
+        auto raw_size = align( static_cast< uint32_t >( size > headers_size ? size - headers_size : 0 ), file_alignment );
+        raw_size = raw_size ? raw_size : file_alignment;
+
+        auto resource_raw_size = align( static_cast< uint32_t >( resource_size ), file_alignment );
+        auto resource_address = section_alignment + align( raw_size, section_alignment );
+        auto image_size = resource_address + align( resource_raw_size, section_alignment );
+
+        std::vector< uint8_t > image( headers_size + raw_size + resource_raw_size + overlay_size );
+
+        // IMAGE_DOS_HEADER, e_lfanew right after it
+        put< uint16_t >( image, 0x00, 0x5a4d );
+        put< uint32_t >( image, 0x3c, 0x40 );
+
+        // IMAGE_FILE_HEADER: amd64, one section, executable | large address aware | dll
+        const size_t nt = 0x40;
+        put< uint32_t >( image, nt, 0x00004550 );
+        put< uint16_t >( image, nt + 4, 0x8664 );
+        put< uint16_t >( image, nt + 6, resource_size ? 2 : 1 );
+        put< uint16_t >( image, nt + 20, 0xf0 );
+        put< uint16_t >( image, nt + 22, 0x2022 );
+
+        // IMAGE_OPTIONAL_HEADER64
+        const size_t optional = nt + 24;
+        put< uint16_t >( image, optional, 0x20b );
+        put< uint32_t >( image, optional + 4, raw_size );
+        put< uint32_t >( image, optional + 16, section_alignment );
+        put< uint32_t >( image, optional + 20, section_alignment );
+        put< uint64_t >( image, optional + 24, 0x180000000ull );
+        put< uint32_t >( image, optional + 32, section_alignment );
+        put< uint32_t >( image, optional + 36, file_alignment );
+        put< uint16_t >( image, optional + 40, 6 );
+        put< uint16_t >( image, optional + 48, 6 );
+        put< uint32_t >( image, optional + 56, image_size );
+        put< uint32_t >( image, optional + 60, headers_size );
+        put< uint16_t >( image, optional + 68, 2 );
+        put< uint16_t >( image, optional + 70, 0x160 );
+        put< uint64_t >( image, optional + 72, 0x100000 );
+        put< uint64_t >( image, optional + 80, 0x1000 );
+        put< uint64_t >( image, optional + 88, 0x100000 );
+        put< uint64_t >( image, optional + 96, 0x1000 );
+        put< uint32_t >( image, optional + 108, 16 );
+
+        // IMAGE_SECTION_HEADER of .text
+        const size_t section = optional + 0xf0;
+        std::memcpy( image.data( ) + section, ".text", 5 );
+        put< uint32_t >( image, section + 8, raw_size );
+        put< uint32_t >( image, section + 12, section_alignment );
+        put< uint32_t >( image, section + 16, raw_size );
+        put< uint32_t >( image, section + 20, headers_size );
+        put< uint32_t >( image, section + 36, 0x60000020 );
+
+        std::mt19937 generator( seed );
+        for ( size_t offset = headers_size; offset < image.size( ); ++offset )
+            image[ offset ] = static_cast< uint8_t >( generator( ) );
+
+        const size_t directories = optional + 112;
+        if ( resource_size ) {
+            // IMAGE_SECTION_HEADER of .rsrc, initialized read-only data
+            std::memcpy( image.data( ) + section + 40, ".rsrc", 5 );
+            put< uint32_t >( image, section + 48, static_cast< uint32_t >( resource_size ) );
+            put< uint32_t >( image, section + 52, resource_address );
+            put< uint32_t >( image, section + 56, resource_raw_size );
+            put< uint32_t >( image, section + 60, headers_size + raw_size );
+            put< uint32_t >( image, section + 76, 0x40000040 );
+
+            put< uint32_t >( image, directories + 2 * 8, resource_address );
+            put< uint32_t >( image, directories + 2 * 8 + 4, static_cast< uint32_t >( resource_size ) );
+
+            // IMAGE_DEBUG_DIRECTORY of type codeview with its data right behind it
+            const uint32_t debug_data = 0x20;
+            std::memset( image.data( ) + headers_size, 0, 12 );
+            put< uint32_t >( image, headers_size + 12, 2 );
+            put< uint32_t >( image, headers_size + 16, 0x40 );
+            put< uint32_t >( image, headers_size + 20, section_alignment + debug_data );
+            put< uint32_t >( image, headers_size + 24, headers_size + debug_data );
+            std::memcpy( image.data( ) + headers_size + debug_data, "RSDS", 4 );
+
+            put< uint32_t >( image, directories + 6 * 8, section_alignment );
+            put< uint32_t >( image, directories + 6 * 8 + 4, 28 );
+        }
+
+        if ( overlay_size ) {
+            put< uint32_t >( image, directories + 4 * 8, headers_size + raw_size + resource_raw_size );
+            put< uint32_t >( image, directories + 4 * 8 + 4, static_cast< uint32_t >( overlay_size ) );
+        }
+
+        return image;
+    }
+
+}
+
+#endif /* PZM_SYNTHETIC_PE_HPP */